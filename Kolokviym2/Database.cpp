@@ -0,0 +1,904 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "Database.h"
+
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <cctype>
+
+std::string get_safe_text(sqlite3_stmt* stmt, int col) {
+    const char* text = (const char*)sqlite3_column_text(stmt, col);
+    return text ? std::string(text) : std::string("");
+}
+
+// Слова запроса -> выражение FTS5: каждое слово берётся в кавычки, чтобы
+// операторы и спецсимволы из запроса не ломали синтаксис MATCH
+std::string fts_query(const std::vector<std::string>& terms)
+{
+    std::string out;
+    for (std::string word : terms) {
+        bool prefix = !word.empty() && word.back() == '*';
+        if (prefix) word.pop_back();
+        if (word.empty()) continue;
+        if (!out.empty()) out += ' ';
+        out += '"';
+        for (char c : word) {
+            if (c == '"') out += '"';
+            out += c;
+        }
+        out += '"';
+        if (prefix) out += '*';
+    }
+    return out;
+}
+
+// Строка выборки "id, title, description, status" в переиспользуемую задачу:
+// assign не выделяет память, если ёмкости строк хватает
+void read_task(sqlite3_stmt* row, Task& t)
+{
+    auto text = [row](int col) {
+        const char* p = (const char*)sqlite3_column_text(row, col);
+        return p ? p : "";
+    };
+    t.id = sqlite3_column_int(row, 0);
+    t.title.assign(text(1), sqlite3_column_bytes(row, 1));
+    t.description.assign(text(2), sqlite3_column_bytes(row, 2));
+    t.status.assign(text(3), sqlite3_column_bytes(row, 3));
+}
+
+// То же без копирования: указатели живут до следующего шага курсора.
+// sqlite3_column_bytes вызывается после sqlite3_column_text, чтобы длина
+// была длиной уже полученного текста.
+TaskView read_view(sqlite3_stmt* row)
+{
+    TaskView v;
+    v.id = sqlite3_column_int(row, 0);
+    const char* p;
+    if ((p = (const char*)sqlite3_column_text(row, 1))) {
+        v.title = p;
+        v.titleLen = (size_t)sqlite3_column_bytes(row, 1);
+    }
+    if ((p = (const char*)sqlite3_column_text(row, 2))) {
+        v.description = p;
+        v.descriptionLen = (size_t)sqlite3_column_bytes(row, 2);
+    }
+    if ((p = (const char*)sqlite3_column_text(row, 3))) {
+        v.status = p;
+        v.statusLen = (size_t)sqlite3_column_bytes(row, 3);
+    }
+    return v;
+}
+
+sqlite3_stmt* prepare_stmt(sqlite3* db, const char* sql)
+{
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, 0) != SQLITE_OK) {
+        std::cerr << "SQL Error: " << sqlite3_errmsg(db) << std::endl;
+        return nullptr;
+    }
+    return stmt;
+}
+
+void ReadConnection::prepare()
+{
+    // Статус хранится кодом; имя подставляет подзапрос по первичному ключу
+    // справочника, так что обход идёт по tasks в порядке id без сортировки
+    const std::string select = "SELECT t.id, t.title, t.description, "
+        "(SELECT name FROM task_statuses WHERE code = t.status) FROM tasks t ";
+    selectAllStmt = prepare_stmt(db, (select + "ORDER BY t.id;").c_str());
+    selectOneStmt = prepare_stmt(db, (select + "WHERE t.id = ?;").c_str());
+    selectPageStmt = prepare_stmt(db, (select + "WHERE t.id > ? ORDER BY t.id LIMIT ?;").c_str());
+    selectStatusPageStmt = prepare_stmt(db, (select + "WHERE t.status = (SELECT code FROM task_statuses WHERE name = ?) "
+        "AND t.id > ? ORDER BY t.id LIMIT ?;").c_str());
+
+    // Порядок по rank (bm25 с весами из конфигурации tasks_fts)
+    const std::string search = "SELECT t.id, t.title, t.description, "
+        "(SELECT name FROM task_statuses WHERE code = t.status)";
+    const std::string match = " FROM tasks_fts JOIN tasks t ON t.id = tasks_fts.rowid "
+        "WHERE tasks_fts MATCH ? ORDER BY rank LIMIT ?;";
+    searchStmt = prepare_stmt(db, (search + match).c_str());
+    searchSnippetStmt = prepare_stmt(db, (search + ", snippet(tasks_fts, -1, '<b>', '</b>', '...', 12)" + match).c_str());
+
+    // Для надгробий столбцы задачи NULL, id берётся из task_changes
+    changesStmt = prepare_stmt(db, (search + ", c.task_id, c.version, c.deleted FROM task_changes c "
+        "LEFT JOIN tasks t ON t.id = c.task_id WHERE c.version > ? ORDER BY c.version LIMIT ?;").c_str());
+}
+
+void ReadConnection::finalize()
+{
+    sqlite3_finalize(selectAllStmt);
+    sqlite3_finalize(selectOneStmt);
+    sqlite3_finalize(selectPageStmt);
+    sqlite3_finalize(selectStatusPageStmt);
+    sqlite3_finalize(searchStmt);
+    sqlite3_finalize(searchSnippetStmt);
+    sqlite3_finalize(changesStmt);
+    selectAllStmt = selectOneStmt = selectPageStmt = selectStatusPageStmt = nullptr;
+    searchStmt = searchSnippetStmt = changesStmt = nullptr;
+}
+
+namespace {
+
+const char* const kJournalModes[] = { "delete", "truncate", "persist", "memory", "wal", "off", nullptr };
+const char* const kSyncModes[] = { "off", "normal", "full", "extra", nullptr };
+const char* const kTempStores[] = { "default", "file", "memory", nullptr };
+
+struct PragmaField
+{
+    const char* name;
+    std::string SqliteOptions::* field;
+    // Допустимые значения; nullptr — целое число
+    const char* const* allowed;
+    bool writerOnly;
+};
+
+// В порядке применения: page_size — до первой записи в файл, которую
+// делает переход в WAL; synchronous — после journal_mode, потому что его
+// смысл зависит от режима журнала
+const PragmaField kPragmas[] = {
+    { "page_size", &SqliteOptions::pageSize, nullptr, true },
+    { "journal_mode", &SqliteOptions::journalMode, kJournalModes, true },
+    { "synchronous", &SqliteOptions::synchronous, kSyncModes, true },
+    { "cache_size", &SqliteOptions::cacheSize, nullptr, false },
+    { "mmap_size", &SqliteOptions::mmapSize, nullptr, false },
+    { "temp_store", &SqliteOptions::tempStore, kTempStores, false },
+    { "busy_timeout", &SqliteOptions::busyTimeout, nullptr, false }
+};
+
+void apply_pragmas(sqlite3* conn, const SqliteOptions& opts, bool writer)
+{
+    for (const PragmaField& p : kPragmas) {
+        const std::string& value = opts.*p.field;
+        if (value.empty() || (p.writerOnly && !writer)) continue;
+        std::string sql = std::string("PRAGMA ") + p.name + " = " + value + ";";
+        char* err = nullptr;
+        if (sqlite3_exec(conn, sql.c_str(), 0, 0, &err) != SQLITE_OK) {
+            std::cerr << "SQL Error: " << (err ? err : sqlite3_errmsg(conn)) << std::endl;
+            sqlite3_free(err);
+        }
+    }
+}
+
+// SQLite молча игнорирует недопустимые значения (page_size у существующей
+// базы, mmap_size сверх SQLITE_MAX_MMAP_SIZE), поэтому действующие
+// значения читаются обратно
+nlohmann::json read_pragmas(sqlite3* conn)
+{
+    nlohmann::json out = nlohmann::json::object();
+    for (const PragmaField& p : kPragmas) {
+        std::string sql = std::string("PRAGMA ") + p.name + ";";
+        sqlite3_stmt* stmt = prepare_stmt(conn, sql.c_str());
+        if (stmt && sqlite3_step(stmt) == SQLITE_ROW) {
+            if (sqlite3_column_type(stmt, 0) == SQLITE_INTEGER) out[p.name] = sqlite3_column_int64(stmt, 0);
+            else out[p.name] = get_safe_text(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    return out;
+}
+
+} // namespace
+
+bool SqliteOptions::profile(const std::string& name, SqliteOptions& out)
+{
+    SqliteOptions o;
+    if (name == "durable") {
+        o.synchronous = "full";
+    }
+    else if (name == "fast") {
+        // Коммит в WAL без fsync: при сбое питания теряются последние
+        // транзакции, но база остаётся целой
+        o.synchronous = "normal";
+        o.cacheSize = "-65536";
+        o.mmapSize = "268435456";
+        o.tempStore = "memory";
+    }
+    else if (name != "default") {
+        return false;
+    }
+    out = o;
+    return true;
+}
+
+bool SqliteOptions::set(const std::string& pragma, const std::string& value)
+{
+    for (const PragmaField& p : kPragmas) {
+        if (pragma != p.name) continue;
+        std::string v = value;
+        std::transform(v.begin(), v.end(), v.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        if (!v.empty() && p.allowed) {
+            const char* const* a = p.allowed;
+            while (*a && v != *a) ++a;
+            if (!*a) throw std::invalid_argument(value);
+        }
+        else if (!v.empty()) {
+            size_t pos = 0;
+            std::stoll(v, &pos);
+            if (pos != v.size()) throw std::invalid_argument(value);
+        }
+        this->*p.field = v;
+        return true;
+    }
+    return false;
+}
+
+bool Database::exec(const char* sql)
+{
+    char* err = nullptr;
+    if (sqlite3_exec(db, sql, 0, 0, &err) != SQLITE_OK) {
+        std::cerr << "SQL Error: " << (err ? err : sqlite3_errmsg(db)) << std::endl;
+        sqlite3_free(err);
+        return false;
+    }
+    return true;
+}
+
+long long Database::queryInt(const char* sql, long long def)
+{
+    long long v = def;
+    sqlite3_stmt* stmt = prepare_stmt(db, sql);
+    if (stmt && sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+        v = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return v;
+}
+
+void Database::migrate()
+{
+    exec("CREATE TABLE IF NOT EXISTS task_statuses ("
+        "code INTEGER PRIMARY KEY,"
+        "name TEXT NOT NULL UNIQUE);"
+        "INSERT OR IGNORE INTO task_statuses (code, name) VALUES (0, 'todo'), (1, 'done');");
+
+    long long version = queryInt("PRAGMA user_version;");
+    bool ok = true;
+    if (version < 1) ok = migrateStep(&Database::migrateStatusCodes, 1);
+    if (ok && version < 2) ok = migrateStep(&Database::migrateSearch, 2);
+    if (ok && version < 3) ok = migrateStep(&Database::migrateChanges, 3);
+    if (ok && queryInt("SELECT COUNT(*) FROM sqlite_master WHERE name = 'tasks_fts';") == 0 && fts5Available()) {
+        ok = migrateStep(&Database::migrateSearch, (int)queryInt("PRAGMA user_version;"));
+    }
+    if (!ok) std::cerr << "Schema migration failed" << std::endl;
+}
+
+bool Database::migrateStep(bool (Database::*step)(), int version)
+{
+    std::string bump = "PRAGMA user_version = " + std::to_string(version) + ";";
+    if (exec("BEGIN IMMEDIATE;") && (this->*step)() && exec(bump.c_str()) && exec("COMMIT;")) return true;
+    exec("ROLLBACK;");
+    return false;
+}
+
+bool Database::migrateStatusCodes()
+{
+    bool legacy = queryInt("SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = 'tasks';") > 0;
+    const char* createTasks = "CREATE TABLE tasks_v1 ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "title TEXT NOT NULL,"
+        "description TEXT,"
+        "status INTEGER NOT NULL REFERENCES task_statuses(code));";
+
+    bool ok = exec(createTasks);
+    if (ok && legacy) {
+        // AUTOINCREMENT не должен выдать заново id удалённых задач
+        long long seq = queryInt("SELECT seq FROM sqlite_sequence WHERE name = 'tasks';", -1);
+        ok = exec("INSERT OR IGNORE INTO task_statuses (name) SELECT DISTINCT status FROM tasks;")
+            && exec("INSERT INTO tasks_v1 (id, title, description, status) "
+                "SELECT t.id, t.title, t.description, s.code FROM tasks t JOIN task_statuses s ON s.name = t.status;")
+            && exec("DROP TABLE tasks;");
+        if (ok && seq >= 0) {
+            std::string sql = "DELETE FROM sqlite_sequence WHERE name = 'tasks_v1';"
+                "INSERT INTO sqlite_sequence (name, seq) VALUES ('tasks_v1', " + std::to_string(seq) + ");";
+            ok = exec(sql.c_str());
+        }
+    }
+    return ok && exec("ALTER TABLE tasks_v1 RENAME TO tasks;")
+        && exec("CREATE INDEX idx_tasks_status ON tasks (status);");
+}
+
+bool Database::migrateChanges()
+{
+    return exec("CREATE TABLE task_changes ("
+            "task_id INTEGER PRIMARY KEY,"
+            "version INTEGER NOT NULL,"
+            "deleted INTEGER NOT NULL DEFAULT 0);")
+        && exec("CREATE UNIQUE INDEX idx_task_changes_version ON task_changes (version);")
+        && exec("INSERT INTO task_changes (task_id, version) SELECT id, id FROM tasks;");
+}
+
+bool Database::migrateSearch()
+{
+    if (!fts5Available()) {
+        std::cerr << "SQLite has no fts5 module, search is unavailable" << std::endl;
+        return true;
+    }
+    return exec("CREATE VIRTUAL TABLE tasks_fts USING fts5("
+            "title, description, content = 'tasks', content_rowid = 'id',"
+            "tokenize = 'unicode61 remove_diacritics 2', prefix = '2 3');")
+        && exec("CREATE TRIGGER tasks_fts_ai AFTER INSERT ON tasks BEGIN "
+            "INSERT INTO tasks_fts (rowid, title, description) VALUES (new.id, new.title, new.description); END;")
+        && exec("CREATE TRIGGER tasks_fts_ad AFTER DELETE ON tasks BEGIN "
+            "INSERT INTO tasks_fts (tasks_fts, rowid, title, description) VALUES ('delete', old.id, old.title, old.description); END;")
+        && exec("CREATE TRIGGER tasks_fts_au AFTER UPDATE OF title, description ON tasks BEGIN "
+            "INSERT INTO tasks_fts (tasks_fts, rowid, title, description) VALUES ('delete', old.id, old.title, old.description);"
+            "INSERT INTO tasks_fts (rowid, title, description) VALUES (new.id, new.title, new.description); END;")
+        && exec("INSERT INTO tasks_fts (tasks_fts, rank) VALUES ('rank', 'bm25(10.0, 1.0)');")
+        && exec("INSERT INTO tasks_fts (tasks_fts) VALUES ('rebuild');");
+}
+
+bool Database::fts5Available()
+{
+    if (sqlite3_exec(db, "CREATE VIRTUAL TABLE temp.fts5_probe USING fts5(x);", 0, 0, 0) != SQLITE_OK) return false;
+    sqlite3_exec(db, "DROP TABLE temp.fts5_probe;", 0, 0, 0);
+    return true;
+}
+
+void Database::loadStatuses()
+{
+    std::lock_guard<std::mutex> lock(statusMtx);
+    sqlite3_stmt* stmt = prepare_stmt(db, "SELECT code, name FROM task_statuses;");
+    while (stmt && sqlite3_step(stmt) == SQLITE_ROW) {
+        statusCodes[get_safe_text(stmt, 1)] = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+}
+
+void Database::internStatuses(const std::vector<WriteOp*>& batch)
+{
+    for (const WriteOp* w : batch) {
+        for (size_t i = 0; i < w->count; ++i) {
+            const Mutation& m = w->items[i];
+            if (m.kind == Mutation::Kind::Delete || statusCodes.count(m.task.status)) continue;
+            // Проверка acceptsStatus могла проиграть гонку другому запросу
+            if (statusCodes.size() >= kMaxStatuses || !valid_status(m.task.status)) continue;
+
+            sqlite3_stmt* stmt = prepare_stmt(db, "INSERT OR IGNORE INTO task_statuses (name) VALUES (?);");
+            if (stmt) {
+                sqlite3_bind_text(stmt, 1, m.task.status.c_str(), -1, SQLITE_STATIC);
+                sqlite3_step(stmt);
+            }
+            sqlite3_finalize(stmt);
+            stmt = prepare_stmt(db, "SELECT code FROM task_statuses WHERE name = ?;");
+            if (stmt) {
+                sqlite3_bind_text(stmt, 1, m.task.status.c_str(), -1, SQLITE_STATIC);
+                if (sqlite3_step(stmt) == SQLITE_ROW) {
+                    std::lock_guard<std::mutex> lock(statusMtx);
+                    statusCodes[m.task.status] = sqlite3_column_int(stmt, 0);
+                }
+            }
+            sqlite3_finalize(stmt);
+        }
+    }
+}
+
+bool Database::acceptsStatus(const std::string& status)
+{
+    if (!valid_status(status)) return false;
+    std::lock_guard<std::mutex> lock(statusMtx);
+    return statusCodes.count(status) > 0 || statusCodes.size() < kMaxStatuses;
+}
+
+void Database::rememberStatus(Mutation& op)
+{
+    op.existed = false;
+    if (!selectStatusStmt) return;
+    StmtReset reset(selectStatusStmt);
+    sqlite3_bind_int(selectStatusStmt, 1, op.id);
+    if (sqlite3_step(selectStatusStmt) == SQLITE_ROW) {
+        op.existed = true;
+        op.oldStatus = get_safe_text(selectStatusStmt, 0);
+    }
+}
+
+void Database::updateCounts(const std::vector<WriteOp*>& batch)
+{
+    std::lock_guard<std::mutex> lock(countsMtx);
+    for (const WriteOp* w : batch) {
+        for (size_t i = 0; i < w->count; ++i) {
+            const Mutation* op = &w->items[i];
+            if (op->result <= 0) continue;
+            if (op->existed) {
+                if (--counts.byStatus[op->oldStatus] == 0) counts.byStatus.erase(op->oldStatus);
+                --counts.total;
+            }
+            if (op->kind != Mutation::Kind::Delete) {
+                ++counts.byStatus[op->task.status];
+                ++counts.total;
+            }
+        }
+    }
+}
+
+void Database::updateCache(const std::vector<WriteOp*>& batch)
+{
+    for (WriteOp* w : batch) {
+        for (size_t i = 0; i < w->count; ++i) {
+            Mutation* op = &w->items[i];
+            if (op->result <= 0) continue;
+            switch (op->kind) {
+            case Mutation::Kind::Insert:
+                op->task.id = (int)op->result;
+                known.set(op->task.id);
+                cache.put(op->task);
+                break;
+            case Mutation::Kind::UpdateFull:
+                op->task.id = op->id;
+                cache.put(op->task);
+                break;
+            case Mutation::Kind::UpdateStatus:
+                cache.setStatus(op->id, op->task.status);
+                break;
+            case Mutation::Kind::Delete:
+                known.reset(op->id);
+                cache.erase(op->id);
+                break;
+            }
+        }
+    }
+}
+
+void Database::bumpVersion(const std::vector<WriteOp*>& batch)
+{
+    for (const WriteOp* w : batch) {
+        for (size_t i = 0; i < w->count; ++i) {
+            if (w->items[i].result > 0) {
+                version++;
+                return;
+            }
+        }
+    }
+}
+
+void Database::loadIds()
+{
+    sqlite3_stmt* stmt = prepare_stmt(db, "SELECT id FROM tasks;");
+    while (stmt && sqlite3_step(stmt) == SQLITE_ROW) known.set(sqlite3_column_int(stmt, 0));
+    sqlite3_finalize(stmt);
+}
+
+void Database::loadCounts()
+{
+    sqlite3_stmt* stmt = prepare_stmt(db, "SELECT s.name, COUNT(*) FROM tasks t "
+        "JOIN task_statuses s ON s.code = t.status GROUP BY t.status;");
+    while (stmt && sqlite3_step(stmt) == SQLITE_ROW) {
+        long long n = sqlite3_column_int64(stmt, 1);
+        counts.byStatus[get_safe_text(stmt, 0)] = n;
+        counts.total += n;
+    }
+    sqlite3_finalize(stmt);
+}
+
+long long Database::apply(Mutation& op)
+{
+    sqlite3_stmt* stmt = nullptr;
+    switch (op.kind) {
+    case Mutation::Kind::Insert: stmt = insertStmt; break;
+    case Mutation::Kind::UpdateFull: stmt = updateFullStmt; break;
+    case Mutation::Kind::UpdateStatus: stmt = updateStatusStmt; break;
+    case Mutation::Kind::Delete: stmt = deleteStmt; break;
+    }
+    if (!stmt) return -1;
+    int code = -1;
+    if (op.kind != Mutation::Kind::Delete) {
+        auto it = statusCodes.find(op.task.status);
+        if (it == statusCodes.end()) return -1;
+        code = it->second;
+    }
+    if (op.kind != Mutation::Kind::Insert) rememberStatus(op);
+    StmtReset reset(stmt);
+
+    switch (op.kind) {
+    case Mutation::Kind::Insert:
+        sqlite3_bind_text(stmt, 1, op.task.title.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, op.task.description.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 3, code);
+        break;
+    case Mutation::Kind::UpdateFull:
+        sqlite3_bind_text(stmt, 1, op.task.title.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, op.task.description.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 3, code);
+        sqlite3_bind_int(stmt, 4, op.id);
+        break;
+    case Mutation::Kind::UpdateStatus:
+        sqlite3_bind_int(stmt, 1, code);
+        sqlite3_bind_int(stmt, 2, op.id);
+        break;
+    case Mutation::Kind::Delete:
+        sqlite3_bind_int(stmt, 1, op.id);
+        break;
+    }
+
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        std::cerr << "SQL Error: " << sqlite3_errmsg(db) << std::endl;
+        return -1;
+    }
+    long long result = op.kind == Mutation::Kind::Insert ? sqlite3_last_insert_rowid(db) : sqlite3_changes(db);
+    if (result > 0 && !recordChange(op.kind == Mutation::Kind::Insert ? result : op.id, op.kind == Mutation::Kind::Delete)) return -1;
+    return result;
+}
+
+bool Database::recordChange(long long id, bool deleted)
+{
+    if (!recordChangeStmt) return false;
+    StmtReset reset(recordChangeStmt);
+    sqlite3_bind_int64(recordChangeStmt, 1, id);
+    sqlite3_bind_int64(recordChangeStmt, 2, changeVersion + 1);
+    sqlite3_bind_int(recordChangeStmt, 3, deleted ? 1 : 0);
+    if (sqlite3_step(recordChangeStmt) != SQLITE_DONE) {
+        std::cerr << "SQL Error: " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    changeVersion++;
+    return true;
+}
+
+void Database::fail(WriteOp& w)
+{
+    w.failed = true;
+    for (size_t i = 0; i < w.count; ++i) w.items[i].result = -1;
+}
+
+bool Database::applyOp(WriteOp& w)
+{
+    if (!w.atomic) {
+        for (size_t i = 0; i < w.count; ++i) {
+            if ((w.items[i].result = apply(w.items[i])) < 0) w.failed = true;
+        }
+        return !w.failed;
+    }
+
+    if (sqlite3_exec(db, "SAVEPOINT batch;", 0, 0, 0) != SQLITE_OK) {
+        fail(w);
+        return false;
+    }
+    long long versionBefore = changeVersion;
+    for (size_t i = 0; i < w.count && !w.failed; ++i) {
+        if ((w.items[i].result = apply(w.items[i])) < 0) w.failed = true;
+    }
+    if (w.failed) {
+        fail(w);
+        changeVersion = versionBefore;
+        if (!sqlite3_get_autocommit(db)) sqlite3_exec(db, "ROLLBACK TO batch;", 0, 0, 0);
+    }
+    if (!sqlite3_get_autocommit(db)) sqlite3_exec(db, "RELEASE batch;", 0, 0, 0);
+    return !w.failed;
+}
+
+void Database::commitBatch(std::vector<WriteOp*>& batch)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    internStatuses(batch);
+    // Версии изменений из откатанной транзакции выдаются заново
+    size_t txnStart = 0;
+    long long txnVersion = changeVersion;
+    bool inTxn = sqlite3_exec(db, "BEGIN IMMEDIATE;", 0, 0, 0) == SQLITE_OK;
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+        if (!inTxn) {
+            fail(*batch[i]);
+            continue;
+        }
+        if (!applyOp(*batch[i]) && sqlite3_get_autocommit(db)) {
+            for (size_t j = txnStart; j <= i; ++j) fail(*batch[j]);
+            txnStart = i + 1;
+            changeVersion = txnVersion;
+            inTxn = sqlite3_exec(db, "BEGIN IMMEDIATE;", 0, 0, 0) == SQLITE_OK;
+        }
+    }
+
+    if (inTxn && sqlite3_exec(db, "COMMIT;", 0, 0, 0) != SQLITE_OK) {
+        std::cerr << "SQL Error: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_exec(db, "ROLLBACK;", 0, 0, 0);
+        for (size_t j = txnStart; j < batch.size(); ++j) fail(*batch[j]);
+        changeVersion = txnVersion;
+    }
+}
+
+void Database::notifyChanges(const std::vector<WriteOp*>& batch)
+{
+    if (!changeListener) return;
+    for (const WriteOp* w : batch) {
+        for (size_t i = 0; i < w->count; ++i) {
+            if (w->items[i].result > 0) changeListener(w->items[i]);
+        }
+    }
+}
+
+void Database::writerLoop()
+{
+    std::vector<WriteOp*> batch;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(queueMtx);
+            queueCv.wait(lock, [this] { return stopping || !writeQueue.empty(); });
+            if (writeQueue.empty()) return;
+
+            size_t n = writeQueue.size();
+            if (n > kMaxBatch) n = kMaxBatch;
+            batch.assign(writeQueue.begin(), writeQueue.begin() + n);
+            writeQueue.erase(writeQueue.begin(), writeQueue.begin() + n);
+        }
+        commitBatch(batch);
+        updateCounts(batch);
+        updateCache(batch);
+        bumpVersion(batch);
+        notifyChanges(batch);
+        for (WriteOp* op : batch) op->done.set_value();
+        batch.clear();
+    }
+}
+
+void Database::submit(WriteOp& op)
+{
+    auto done = op.done.get_future();
+    {
+        std::lock_guard<std::mutex> lock(queueMtx);
+        writeQueue.push_back(&op);
+    }
+    queueCv.notify_one();
+    done.wait();
+}
+
+long long Database::submit(Mutation& m)
+{
+    WriteOp op{ &m, 1 };
+    submit(op);
+    return m.result;
+}
+
+Database::Database(const char* filename, const SqliteOptions& opts,
+    unsigned readerCount, size_t cacheBytes)
+    : cache(cacheBytes)
+{
+    sqlite3_open_v2(filename, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, nullptr);
+    apply_pragmas(db, opts, true);
+    pragmas = read_pragmas(db);
+    bool wal = pragmas.value("journal_mode", "") == "wal";
+
+    migrate();
+    loadStatuses();
+
+    insertStmt = prepare_stmt(db, "INSERT INTO tasks (title, description, status) VALUES (?, ?, ?);");
+    updateStatusStmt = prepare_stmt(db, "UPDATE tasks SET status = ? WHERE id = ?;");
+    updateFullStmt = prepare_stmt(db, "UPDATE tasks SET title = ?, description = ?, status = ? WHERE id = ?;");
+    deleteStmt = prepare_stmt(db, "DELETE FROM tasks WHERE id = ?;");
+    selectStatusStmt = prepare_stmt(db, "SELECT (SELECT name FROM task_statuses WHERE code = t.status) FROM tasks t WHERE t.id = ?;");
+    recordChangeStmt = prepare_stmt(db, "INSERT INTO task_changes (task_id, version, deleted) VALUES (?, ?, ?) "
+        "ON CONFLICT (task_id) DO UPDATE SET version = excluded.version, deleted = excluded.deleted;");
+    changeVersion = queryInt("SELECT MAX(version) FROM task_changes;");
+    loadCounts();
+    loadIds();
+
+    writerReads.db = db;
+    writerReads.prepare();
+    writer = std::thread(&Database::writerLoop, this);
+
+    if (!wal) return;
+    if (readerCount == 0) readerCount = 4;
+    for (unsigned i = 0; i < readerCount; ++i) {
+        auto r = std::make_unique<ReadConnection>();
+        if (sqlite3_open_v2(filename, &r->db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK) {
+            std::cerr << "SQL Error: " << sqlite3_errmsg(r->db) << std::endl;
+            sqlite3_close(r->db);
+            break;
+        }
+        apply_pragmas(r->db, opts, false);
+        r->prepare();
+        idleReaders.push_back(r.get());
+        readers.push_back(std::move(r));
+    }
+}
+
+Database::~Database()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMtx);
+        stopping = true;
+    }
+    queueCv.notify_one();
+    writer.join();
+
+    // sqlite3_finalize(nullptr) безопасен, поэтому проверки не нужны
+    for (auto& r : readers) {
+        r->finalize();
+        sqlite3_close(r->db);
+    }
+    writerReads.finalize();
+    sqlite3_finalize(insertStmt);
+    sqlite3_finalize(updateStatusStmt);
+    sqlite3_finalize(updateFullStmt);
+    sqlite3_finalize(deleteStmt);
+    sqlite3_finalize(selectStatusStmt);
+    sqlite3_finalize(recordChangeStmt);
+    sqlite3_close(db);
+}
+
+void Database::addTask(Task& t)
+{
+    Mutation op{ Mutation::Kind::Insert, 0, t };
+    long long id = submit(op);
+    if (id > 0) t.id = (int)id;
+}
+
+bool Database::applyBatch(std::vector<Mutation>& items)
+{
+    if (items.empty()) return true;
+    WriteOp op{ items.data(), items.size(), true };
+    submit(op);
+    return !op.failed;
+}
+
+nlohmann::json Database::cacheStats()
+{
+    return nlohmann::json{
+        { "hits", cache.hits.load() },
+        { "misses", cache.misses.load() },
+        { "negative_hits", negativeHits.load() },
+        { "bytes", cache.bytes() }
+    };
+}
+
+nlohmann::json Database::stats()
+{
+    return nlohmann::json{
+        { "backend", name() },
+        { "pragmas", pragmas },
+        { "cache", cacheStats() }
+    };
+}
+
+long long Database::size()
+{
+    std::lock_guard<std::mutex> lock(countsMtx);
+    return counts.total;
+}
+
+TaskCounts Database::getCounts()
+{
+    std::lock_guard<std::mutex> lock(countsMtx);
+    return counts;
+}
+
+std::vector<Task> Database::getAll()
+{
+    ReadLease conn(*this);
+    std::vector<Task> results;
+    sqlite3_stmt* stmt = conn->selectAllStmt;
+    if (!stmt) return results;
+    StmtReset reset(stmt);
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        results.push_back({
+            sqlite3_column_int(stmt, 0),
+            get_safe_text(stmt, 1),
+            get_safe_text(stmt, 2),
+            get_safe_text(stmt, 3)
+            });
+    }
+    return results;
+}
+
+int Database::search(const std::vector<std::string>& terms, int limit, bool snippet,
+    const std::function<void(const Task&, const std::string&)>& onRow)
+{
+    std::string match = fts_query(terms);
+    if (match.empty()) return 0;
+
+    ReadLease conn(*this);
+    sqlite3_stmt* stmt = snippet ? conn->searchSnippetStmt : conn->searchStmt;
+    if (!stmt) return -1;
+    StmtReset reset(stmt);
+
+    sqlite3_bind_text(stmt, 1, match.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, limit);
+    Task t;
+    std::string text;
+    int rows = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        read_task(stmt, t);
+        if (snippet) text = get_safe_text(stmt, 4);
+        onRow(t, text);
+        ++rows;
+    }
+    return rc == SQLITE_DONE ? rows : -1;
+}
+
+// Строка курсора: столбцы задачи (0-3), затем task_id, version и deleted
+int Database::forEachChangeSince(long long since, int limit,
+    const std::function<void(const TaskChange&)>& onRow)
+{
+    ReadLease conn(*this);
+    sqlite3_stmt* stmt = conn->changesStmt;
+    if (!stmt) return 0;
+    StmtReset reset(stmt);
+
+    sqlite3_bind_int64(stmt, 1, since);
+    sqlite3_bind_int(stmt, 2, limit);
+    TaskChange c;
+    int rows = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        c.id = sqlite3_column_int(stmt, 4);
+        c.version = sqlite3_column_int64(stmt, 5);
+        c.deleted = sqlite3_column_int(stmt, 6) != 0;
+        if (!c.deleted) read_task(stmt, c.task);
+        onRow(c);
+        ++rows;
+    }
+    return rows;
+}
+
+int Database::forEachAfter(int afterId, int limit, const std::string& status,
+    const std::function<void(const TaskView&)>& onRow)
+{
+    ReadLease conn(*this);
+    sqlite3_stmt* stmt = status.empty() ? conn->selectPageStmt : conn->selectStatusPageStmt;
+    if (!stmt) return 0;
+    StmtReset reset(stmt);
+
+    int n = 1;
+    if (!status.empty()) sqlite3_bind_text(stmt, n++, status.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, n++, afterId);
+    sqlite3_bind_int(stmt, n++, limit);
+    int rows = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        onRow(read_view(stmt));
+        ++rows;
+    }
+    return rows;
+}
+
+std::vector<Task> Database::getPage(int afterId, int limit)
+{
+    std::vector<Task> results;
+    forEachAfter(afterId, limit, "", [&](const TaskView& t) { results.push_back(t.toTask()); });
+    return results;
+}
+
+std::pair<bool, Task> Database::getOne(int id)
+{
+    Task t;
+    bool found = false;
+    if (!known.test(id)) {
+        negativeHits++;
+        return { found, t };
+    }
+    if (cache.get(id, t)) return { true, t };
+
+    uint64_t epoch = cache.epoch(id);
+    ReadLease conn(*this);
+    sqlite3_stmt* stmt = conn->selectOneStmt;
+    if (!stmt) return { found, t };
+    StmtReset reset(stmt);
+
+    sqlite3_bind_int(stmt, 1, id);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        t.id = sqlite3_column_int(stmt, 0);
+        t.title = get_safe_text(stmt, 1);
+        t.description = get_safe_text(stmt, 2);
+        t.status = get_safe_text(stmt, 3);
+        found = true;
+        cache.fill(t, epoch);
+    }
+    return { found, t };
+}
+
+bool Database::updateStatus(int id, std::string status)
+{
+    Mutation op{ Mutation::Kind::UpdateStatus, id };
+    op.task.status = std::move(status);
+    return submit(op) > 0;
+}
+
+bool Database::updateFull(int id, const Task& t)
+{
+    Mutation op{ Mutation::Kind::UpdateFull, id, t };
+    return submit(op) > 0;
+}
+
+bool Database::deleteTask(int id)
+{
+    Mutation op{ Mutation::Kind::Delete, id };
+    return submit(op) > 0;
+}
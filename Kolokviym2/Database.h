@@ -0,0 +1,477 @@
+#ifndef DATABASE_H
+#define DATABASE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <future>
+#include <functional>
+#include <cstdint>
+
+#include "sqlite3.h"
+#include "json.hpp"
+#include "TaskStore.h"
+
+std::string get_safe_text(sqlite3_stmt* stmt, int col);
+
+// Сбрасывает подготовленный запрос после использования, чтобы его можно было выполнить снова
+class StmtReset
+{
+    sqlite3_stmt* stmt;
+
+public:
+    explicit StmtReset(sqlite3_stmt* s) : stmt(s) {}
+    ~StmtReset()
+    {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+    StmtReset(const StmtReset&) = delete;
+    StmtReset& operator=(const StmtReset&) = delete;
+};
+
+// Компилирует запрос для многократного выполнения; nullptr при ошибке
+sqlite3_stmt* prepare_stmt(sqlite3* db, const char* sql);
+
+// Настройки SQLite, применяемые при открытии базы. Значения — как в PRAGMA;
+// пустая строка оставляет значение SQLite по умолчанию. Только писателю
+// задаются page_size (действует лишь на новую базу), journal_mode (хранится
+// в файле) и synchronous (читатели ничего не коммитят). cache_size,
+// mmap_size, temp_store и busy_timeout задаются каждому соединению.
+struct SqliteOptions
+{
+    std::string journalMode = "wal";
+    std::string synchronous;
+    std::string cacheSize;
+    std::string mmapSize;
+    std::string tempStore;
+    std::string pageSize;
+    std::string busyTimeout = "5000";
+
+    // default — как раньше (WAL и busy_timeout), durable — fsync на каждый
+    // коммит, fast — synchronous=NORMAL, большой кэш, mmap и временные
+    // таблицы в памяти. false для неизвестного имени.
+    static bool profile(const std::string& name, SqliteOptions& out);
+
+    // Одна настройка по имени PRAGMA (journal_mode, cache_size, ...).
+    // false для неизвестного имени, std::invalid_argument для плохого значения.
+    bool set(const std::string& pragma, const std::string& value);
+};
+
+// Соединение для чтения вместе со своими подготовленными запросами
+struct ReadConnection
+{
+    sqlite3* db = nullptr;
+    sqlite3_stmt* selectAllStmt = nullptr;
+    sqlite3_stmt* selectOneStmt = nullptr;
+    sqlite3_stmt* selectPageStmt = nullptr;
+    sqlite3_stmt* selectStatusPageStmt = nullptr;
+    sqlite3_stmt* searchStmt = nullptr;
+    sqlite3_stmt* searchSnippetStmt = nullptr;
+    sqlite3_stmt* changesStmt = nullptr;
+
+    void prepare();
+    void finalize();
+};
+
+// Множество существующих id: по биту на id, блоки выделяются лениво.
+// Чтение без блокировок, меняет только поток писателя.
+class IdBitmap
+{
+    static const int kChunkBits = 1 << 16;
+    static const int kWordsPerChunk = kChunkBits / 64;
+    static const int kChunks = (1u << 31) / kChunkBits;
+
+    struct Chunk
+    {
+        std::atomic<uint64_t> words[kWordsPerChunk];
+        Chunk() { for (auto& w : words) w.store(0, std::memory_order_relaxed); }
+    };
+    std::unique_ptr<std::atomic<Chunk*>[]> chunks;
+
+public:
+    IdBitmap() : chunks(new std::atomic<Chunk*>[kChunks])
+    {
+        for (int i = 0; i < kChunks; ++i) chunks[i].store(nullptr, std::memory_order_relaxed);
+    }
+    ~IdBitmap()
+    {
+        for (int i = 0; i < kChunks; ++i) delete chunks[i].load(std::memory_order_relaxed);
+    }
+    IdBitmap(const IdBitmap&) = delete;
+    IdBitmap& operator=(const IdBitmap&) = delete;
+
+    bool test(int id) const
+    {
+        if (id <= 0) return false;
+        Chunk* c = chunks[id / kChunkBits].load(std::memory_order_acquire);
+        if (!c) return false;
+        int bit = id % kChunkBits;
+        return (c->words[bit / 64].load(std::memory_order_acquire) >> (bit % 64)) & 1;
+    }
+
+    void set(int id)
+    {
+        if (id <= 0) return;
+        Chunk* c = chunks[id / kChunkBits].load(std::memory_order_acquire);
+        if (!c) {
+            c = new Chunk();
+            chunks[id / kChunkBits].store(c, std::memory_order_release);
+        }
+        int bit = id % kChunkBits;
+        c->words[bit / 64].fetch_or(uint64_t(1) << (bit % 64), std::memory_order_release);
+    }
+
+    void reset(int id)
+    {
+        if (id <= 0) return;
+        Chunk* c = chunks[id / kChunkBits].load(std::memory_order_acquire);
+        if (!c) return;
+        int bit = id % kChunkBits;
+        c->words[bit / 64].fetch_and(~(uint64_t(1) << (bit % 64)), std::memory_order_release);
+    }
+};
+
+// LRU-кэш задач по id с ограничением по байтам, разбитый на шарды.
+// Поток писателя обновляет кэш после коммита (write-through). Читатель,
+// заполняющий кэш из БД, передаёт эпоху шарда, снятую до запроса: если
+// писатель успел что-то поменять в шарде, устаревшая строка не попадёт в кэш.
+class TaskCache
+{
+    struct Entry
+    {
+        Task task;
+        size_t bytes;
+    };
+    struct Shard
+    {
+        std::mutex mtx;
+        std::list<Entry> lru;
+        std::unordered_map<int, std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+        uint64_t epoch = 0;
+    };
+
+    static const size_t kShards = 16;
+    Shard shards[kShards];
+    size_t shardBudget;
+
+    Shard& shardFor(int id) { return shards[(unsigned)id % kShards]; }
+
+    static size_t entryBytes(const Task& t)
+    {
+        return sizeof(Entry) + t.title.capacity() + t.description.capacity() + t.status.capacity() + 64;
+    }
+
+    void eraseLocked(Shard& s, int id)
+    {
+        auto it = s.index.find(id);
+        if (it == s.index.end()) return;
+        s.bytes -= it->second->bytes;
+        s.lru.erase(it->second);
+        s.index.erase(it);
+    }
+
+    void insertLocked(Shard& s, const Task& t)
+    {
+        eraseLocked(s, t.id);
+        size_t bytes = entryBytes(t);
+        if (bytes > shardBudget) return;
+        s.lru.push_front(Entry{ t, bytes });
+        s.index[t.id] = s.lru.begin();
+        s.bytes += bytes;
+        while (s.bytes > shardBudget) {
+            s.bytes -= s.lru.back().bytes;
+            s.index.erase(s.lru.back().task.id);
+            s.lru.pop_back();
+        }
+    }
+
+public:
+    std::atomic<long long> hits{ 0 };
+    std::atomic<long long> misses{ 0 };
+
+    explicit TaskCache(size_t budgetBytes) : shardBudget(budgetBytes / kShards) {}
+
+    uint64_t epoch(int id)
+    {
+        Shard& s = shardFor(id);
+        std::lock_guard<std::mutex> lock(s.mtx);
+        return s.epoch;
+    }
+
+    bool get(int id, Task& out)
+    {
+        Shard& s = shardFor(id);
+        std::lock_guard<std::mutex> lock(s.mtx);
+        auto it = s.index.find(id);
+        if (it == s.index.end()) {
+            misses++;
+            return false;
+        }
+        s.lru.splice(s.lru.begin(), s.lru, it->second);
+        out = it->second->task;
+        hits++;
+        return true;
+    }
+
+    // Заполнение после чтения из БД
+    void fill(const Task& t, uint64_t seenEpoch)
+    {
+        Shard& s = shardFor(t.id);
+        std::lock_guard<std::mutex> lock(s.mtx);
+        if (s.epoch != seenEpoch) return;
+        insertLocked(s, t);
+    }
+
+    // Изменения от писателя
+    void put(const Task& t)
+    {
+        Shard& s = shardFor(t.id);
+        std::lock_guard<std::mutex> lock(s.mtx);
+        s.epoch++;
+        insertLocked(s, t);
+    }
+
+    void setStatus(int id, const std::string& status)
+    {
+        Shard& s = shardFor(id);
+        std::lock_guard<std::mutex> lock(s.mtx);
+        s.epoch++;
+        auto it = s.index.find(id);
+        if (it == s.index.end()) return;
+        Task t = it->second->task;
+        t.status = status;
+        insertLocked(s, t);
+    }
+
+    void erase(int id)
+    {
+        Shard& s = shardFor(id);
+        std::lock_guard<std::mutex> lock(s.mtx);
+        s.epoch++;
+        eraseLocked(s, id);
+    }
+
+    size_t bytes()
+    {
+        size_t total = 0;
+        for (auto& s : shards) {
+            std::lock_guard<std::mutex> lock(s.mtx);
+            total += s.bytes;
+        }
+        return total;
+    }
+};
+
+// Заявка в очереди писателя: одно изменение или атомарная группа
+// (POST /tasks/batch), которая применяется целиком или не применяется вовсе
+struct WriteOp
+{
+    Mutation* items;
+    size_t count;
+    bool atomic;
+    bool failed = false;
+    std::promise<void> done;
+
+    WriteOp(Mutation* items, size_t count, bool atomic = false)
+        : items(items), count(count), atomic(atomic) {}
+};
+
+// Один писатель и пул читателей в режиме WAL: чтения не ждут записей.
+// Для ":memory:" (и если WAL недоступен) читатели не создаются,
+// и чтение идёт через соединение писателя под его мьютексом.
+// Все изменения выполняет отдельный поток писателя: параллельные запросы
+// собираются в пакет и фиксируются одной транзакцией (group commit).
+class Database : public TaskStore
+{
+    sqlite3* db;
+    std::mutex mtx;
+
+    // Запросы компилируются один раз при открытии соединения
+    sqlite3_stmt* insertStmt = nullptr;
+    sqlite3_stmt* updateStatusStmt = nullptr;
+    sqlite3_stmt* updateFullStmt = nullptr;
+    sqlite3_stmt* deleteStmt = nullptr;
+    sqlite3_stmt* selectStatusStmt = nullptr;
+    sqlite3_stmt* recordChangeStmt = nullptr;
+
+    // Последняя версия журнала изменений, её ведёт поток писателя. Версии
+    // откатанных изменений выдаются заново, так что выданные версии идут
+    // без пропусков. В task_changes одна строка на задачу, поэтому в самой
+    // таблице пропуски есть: курсор since опирается только на рост версий.
+    long long changeVersion = 0;
+
+    // Справочник статусов name -> code. Меняет только поток писателя под
+    // statusMtx и читает без блокировки; остальные потоки — под statusMtx.
+    // Больше kMaxStatuses статусов не заносится: такие изменения не проходят.
+    std::unordered_map<std::string, int> statusCodes;
+    std::mutex statusMtx;
+
+    // Счётчики задач ведёт поток писателя после каждого коммита
+    TaskCounts counts;
+    std::mutex countsMtx;
+
+    // Кэш точечных чтений и множество существующих id для быстрых 404
+    TaskCache cache;
+    IdBitmap known;
+    std::atomic<long long> negativeHits{ 0 };
+
+    // Растёт после каждого пакета, который что-то изменил; основа ETag
+    std::atomic<uint64_t> version{ 1 };
+
+    ReadConnection writerReads;
+    std::vector<std::unique_ptr<ReadConnection>> readers;
+    std::vector<ReadConnection*> idleReaders;
+    std::mutex poolMtx;
+    std::condition_variable poolCv;
+
+    static const size_t kMaxBatch = 256;
+    std::vector<WriteOp*> writeQueue;
+    std::mutex queueMtx;
+    std::condition_variable queueCv;
+    bool stopping = false;
+    std::thread writer;
+
+    // Выдаёт свободное соединение для чтения на время своей жизни
+    class ReadLease
+    {
+        Database& owner;
+        ReadConnection* conn = nullptr;
+        std::unique_lock<std::mutex> writerLock;
+
+    public:
+        explicit ReadLease(Database& d) : owner(d)
+        {
+            if (owner.readers.empty()) {
+                writerLock = std::unique_lock<std::mutex>(owner.mtx);
+                conn = &owner.writerReads;
+                return;
+            }
+            std::unique_lock<std::mutex> lock(owner.poolMtx);
+            owner.poolCv.wait(lock, [this] { return !owner.idleReaders.empty(); });
+            conn = owner.idleReaders.back();
+            owner.idleReaders.pop_back();
+        }
+        ~ReadLease()
+        {
+            if (writerLock.owns_lock()) return;
+            {
+                std::lock_guard<std::mutex> lock(owner.poolMtx);
+                owner.idleReaders.push_back(conn);
+            }
+            owner.poolCv.notify_one();
+        }
+        ReadLease(const ReadLease&) = delete;
+        ReadLease& operator=(const ReadLease&) = delete;
+
+        ReadConnection* operator->() const { return conn; }
+    };
+
+    // Действующие значения PRAGMA, прочитанные при открытии
+    nlohmann::json pragmas;
+
+    bool exec(const char* sql);
+    long long queryInt(const char* sql, long long def = 0);
+
+    // Версия схемы хранится в PRAGMA user_version, каждый шаг — отдельная транзакция.
+    // v1: статус — код из справочника task_statuses, индекс по статусу.
+    // v2: полнотекстовый индекс tasks_fts по title и description.
+    // v3: журнал изменений task_changes для /tasks/changes.
+    // Без модуля fts5 шаг v2 проходит без индекса, чтобы не задерживать v3;
+    // индекс создаётся при первом запуске, где fts5 есть.
+    void migrate();
+    bool migrateStep(bool (Database::*step)(), int version);
+    bool migrateStatusCodes();
+
+    // Одна строка на задачу: версия последнего изменения и признак удаления
+    // (надгробие). Существующие задачи получают версии, равные их id.
+    bool migrateChanges();
+
+    // External-content FTS5: текст хранится только в tasks, индекс
+    // поддерживают триггеры. Заголовок весит в ранжировании больше описания.
+    bool migrateSearch();
+    bool fts5Available();
+    void loadStatuses();
+
+    // Новые статусы заносятся в справочник до начала транзакции пакета,
+    // чтобы откат пакета не оставил в памяти код, которого нет в БД
+    void internStatuses(const std::vector<WriteOp*>& batch);
+    void rememberStatus(Mutation& op);
+    void updateCounts(const std::vector<WriteOp*>& batch);
+
+    // Вызывается писателем после коммита, до ответа клиентам
+    void updateCache(const std::vector<WriteOp*>& batch);
+    void bumpVersion(const std::vector<WriteOp*>& batch);
+    void loadIds();
+    void loadCounts();
+    long long apply(Mutation& op);
+
+    // Версии выдаются единственным писателем в порядке применения, поэтому
+    // любой снимок читателя видит непрерывный префикс журнала
+    bool recordChange(long long id, bool deleted);
+    void fail(WriteOp& w);
+
+    // Атомарная группа выполняется внутри SAVEPOINT: при ошибке SQL
+    // откатывается только она, остальные заявки пакета не страдают.
+    // Возвращает false, если операция не удалась.
+    bool applyOp(WriteOp& w);
+
+    // Выполняет пакет в одной транзакции. Если SQLite откатил транзакцию
+    // посреди пакета, уже выполненные в ней операции считаются неудачными.
+    void commitBatch(std::vector<WriteOp*>& batch);
+    void notifyChanges(const std::vector<WriteOp*>& batch);
+    void writerLoop();
+
+    // Ставит заявку в очередь и ждёт, пока её пакет будет зафиксирован
+    void submit(WriteOp& op);
+    long long submit(Mutation& m);
+
+public:
+    Database(const char* filename, const SqliteOptions& opts = SqliteOptions(),
+        unsigned readerCount = std::thread::hardware_concurrency(),
+        size_t cacheBytes = 64u << 20);
+    ~Database();
+    Database(const Database&) = delete;
+    Database& operator=(const Database&) = delete;
+
+    const char* name() const override { return "sqlite"; }
+    bool acceptsStatus(const std::string& status) override;
+
+    void addTask(Task& t) override;
+    bool applyBatch(std::vector<Mutation>& items) override;
+
+    nlohmann::json cacheStats();
+    nlohmann::json stats() override;
+
+    uint64_t dataVersion() const override { return version.load(); }
+
+    long long size() override;
+    TaskCounts getCounts() override;
+    std::vector<Task> getAll() override;
+
+    // Выражение FTS5 MATCH собирается из слов запроса (см. fts_query)
+    int search(const std::vector<std::string>& terms, int limit, bool snippet,
+        const std::function<void(const Task&, const std::string&)>& onRow) override;
+    int forEachChangeSince(long long since, int limit,
+        const std::function<void(const TaskChange&)>& onRow) override;
+
+    // Статус фильтруется по индексу idx_tasks_status
+    int forEachAfter(int afterId, int limit, const std::string& status,
+        const std::function<void(const TaskView&)>& onRow) override;
+
+    std::vector<Task> getPage(int afterId, int limit);
+    std::pair<bool, Task> getOne(int id) override;
+    bool updateStatus(int id, std::string status) override;
+    bool updateFull(int id, const Task& t) override;
+    bool deleteTask(int id) override;
+};
+
+#endif // DATABASE_H
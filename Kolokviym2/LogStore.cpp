@@ -0,0 +1,591 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "LogStore.h"
+
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include <zlib.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char kSnapshotMagic[4] = { 'T', 'S', 'N', 'P' };
+const uint32_t kSnapshotFormat = 1;
+const size_t kWriteChunk = 1u << 20;
+
+enum EntryKind : uint8_t { Put = 0, Erase = 1 };
+
+// Файловые операции на уровне дескрипторов: fsync из фонового потока
+// не должен ждать буферов stdio, которыми пользуется писатель
+int open_append(const std::string& path)
+{
+#ifdef _WIN32
+    return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+#endif
+}
+
+int open_truncate(const std::string& path)
+{
+#ifdef _WIN32
+    return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+}
+
+bool write_all(int fd, const char* data, size_t n)
+{
+    while (n > 0) {
+#ifdef _WIN32
+        int w = _write(fd, data, (unsigned)std::min(n, kWriteChunk));
+#else
+        ssize_t w = ::write(fd, data, n);
+#endif
+        if (w <= 0) return false;
+        data += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+bool sync_fd(int fd)
+{
+#ifdef _WIN32
+    return _commit(fd) == 0;
+#else
+    return ::fsync(fd) == 0;
+#endif
+}
+
+void close_fd(int fd)
+{
+#ifdef _WIN32
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+bool file_exists(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+bool truncate_file(const std::string& path, long long size)
+{
+#ifdef _WIN32
+    int fd = _open(path.c_str(), _O_WRONLY | _O_BINARY);
+    if (fd < 0) return false;
+    bool ok = _chsize_s(fd, size) == 0;
+    _close(fd);
+    return ok;
+#else
+    return ::truncate(path.c_str(), (off_t)size) == 0;
+#endif
+}
+
+// rename поверх существующего файла атомарен на POSIX; на Windows его
+// заменяет MoveFileEx с MOVEFILE_REPLACE_EXISTING
+bool replace_file(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// Файл, отображённый в память только для чтения
+class MappedFile
+{
+    const char* ptr = nullptr;
+    size_t len = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+public:
+    explicit MappedFile(const std::string& path)
+    {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) return;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) return;
+        ptr = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (ptr) len = (size_t)size.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+                ptr = (const char*)p;
+                len = (size_t)st.st_size;
+            }
+        }
+        ::close(fd);
+#endif
+    }
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (ptr) UnmapViewOfFile(ptr);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (ptr) munmap((void*)ptr, len);
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return ptr; }
+    size_t size() const { return len; }
+};
+
+template <class T>
+void put(std::string& out, T v)
+{
+    out.append((const char*)&v, sizeof(v));
+}
+
+void put_string(std::string& out, const std::string& s)
+{
+    put(out, (uint32_t)s.size());
+    out += s;
+}
+
+void put_entry(std::string& out, int id, long long version, const Task* t)
+{
+    put(out, (uint8_t)(t ? Put : Erase));
+    put(out, (int32_t)id);
+    put(out, (int64_t)version);
+    if (!t) return;
+    put_string(out, t->title);
+    put_string(out, t->description);
+    put_string(out, t->status);
+}
+
+// Чтение из отображённого файла; после выхода за границу ok == false
+struct Cursor
+{
+    const char* p;
+    const char* end;
+    bool ok = true;
+
+    Cursor(const char* begin, const char* end) : p(begin), end(end) {}
+
+    template <class T>
+    T get()
+    {
+        T v = T();
+        if (!ok || (size_t)(end - p) < sizeof(T)) {
+            ok = false;
+            return v;
+        }
+        std::memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+
+    void getString(std::string& s)
+    {
+        uint32_t n = get<uint32_t>();
+        if (!ok || (size_t)(end - p) < n) {
+            ok = false;
+            return;
+        }
+        s.assign(p, n);
+        p += n;
+    }
+};
+
+uint32_t checksum(const char* data, size_t n, uint32_t crc = 0)
+{
+    while (n > 0) {
+        uInt chunk = (uInt)std::min(n, (size_t)1 << 30);
+        crc = (uint32_t)crc32(crc, (const Bytef*)data, chunk);
+        data += chunk;
+        n -= chunk;
+    }
+    return crc;
+}
+
+long long ms_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+// Снимок: магия, формат, lsn последней учтённой записи журнала, затем
+// записи вида журнальных, в конце последний выданный id, число записей
+// и CRC32 всего, что до неё.
+bool LogStore::loadSnapshot()
+{
+    MappedFile file(snapshotPath);
+    if (!file.data()) return !file_exists(snapshotPath);
+
+    const size_t header = sizeof(kSnapshotMagic) + sizeof(uint32_t) + sizeof(uint64_t);
+    const size_t trailer = sizeof(int32_t) + sizeof(uint64_t) + sizeof(uint32_t);
+    const char* begin = file.data();
+    size_t size = file.size();
+    if (size < header + trailer || std::memcmp(begin, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0) return false;
+
+    Cursor tail(begin + size - trailer, begin + size);
+    int32_t lastId = tail.get<int32_t>();
+    uint64_t count = tail.get<uint64_t>();
+    uint32_t crc = tail.get<uint32_t>();
+    if (checksum(begin, size - sizeof(uint32_t)) != crc) return false;
+
+    Cursor c(begin + sizeof(kSnapshotMagic), begin + size - trailer);
+    if (c.get<uint32_t>() != kSnapshotFormat) return false;
+    uint64_t snapLsn = c.get<uint64_t>();
+
+    Task t;
+    for (uint64_t i = 0; i < count && c.ok; ++i) {
+        uint8_t kind = c.get<uint8_t>();
+        int id = c.get<int32_t>();
+        long long version = c.get<int64_t>();
+        if (kind == Erase) {
+            if (c.ok) restoreDelete(id, version);
+            continue;
+        }
+        t.id = id;
+        c.getString(t.title);
+        c.getString(t.description);
+        c.getString(t.status);
+        if (c.ok) restorePut(t, version);
+    }
+    if (!c.ok) return false;
+    restoreLastId(lastId);
+    lsn = snapLsn;
+    snapshotLsn = snapLsn;
+    return true;
+}
+
+// Запись журнала: длина и CRC32 тела, затем тело — lsn, число записей
+// и сами записи
+void LogStore::replayJournal(const std::string& path, bool truncateTail)
+{
+    long long good = 0;
+    bool damaged = false;
+    {
+        MappedFile file(path);
+        if (!file.data()) return;
+        const char* p = file.data();
+        const char* end = p + file.size();
+        Task t;
+        while (p < end) {
+            Cursor head(p, end);
+            uint32_t len = head.get<uint32_t>();
+            uint32_t crc = head.get<uint32_t>();
+            if (!head.ok || (size_t)(end - head.p) < len || checksum(head.p, len) != crc) {
+                damaged = true;
+                break;
+            }
+            Cursor c(head.p, head.p + len);
+            uint64_t recLsn = c.get<uint64_t>();
+            uint32_t count = c.get<uint32_t>();
+            if (recLsn > snapshotLsn) {
+                for (uint32_t i = 0; i < count && c.ok; ++i) {
+                    uint8_t kind = c.get<uint8_t>();
+                    int id = c.get<int32_t>();
+                    long long version = c.get<int64_t>();
+                    if (kind == Erase) {
+                        if (c.ok) restoreDelete(id, version);
+                        continue;
+                    }
+                    t.id = id;
+                    c.getString(t.title);
+                    c.getString(t.description);
+                    c.getString(t.status);
+                    if (c.ok) restorePut(t, version);
+                }
+                replayedRecords++;
+            }
+            if (recLsn > lsn) lsn = recLsn;
+            p = head.p + len;
+            good = p - file.data();
+        }
+    }
+    journalBytes += good;
+    if (!damaged) return;
+
+    std::cerr << "Log store: damaged record in " << path << " at offset " << good << std::endl;
+    // Иначе следующие записи легли бы после мусора и не прочитались бы
+    if (truncateTail && !truncate_file(path, good)) {
+        std::cerr << "Log store: cannot truncate " << path << std::endl;
+    }
+}
+
+LogStore::LogStore(const std::string& base, JournalOptions opts)
+    : opts(opts), journalPath(base + ".journal"), oldJournalPath(base + ".journal.old"),
+    snapshotPath(base + ".snapshot")
+{
+    serializeWrites = true;
+    auto start = std::chrono::steady_clock::now();
+    // Журнал до снимка уже удалён, и без снимка состояние не восстановить.
+    // Файл не трогается: следующий снимок записал бы поверх него неполные
+    // данные.
+    if (!loadSnapshot()) {
+        std::cerr << "Log store: snapshot " << snapshotPath << " is damaged, refusing to start;"
+            " restore it from a backup or move it aside to start from the journal alone" << std::endl;
+        std::abort();
+    }
+    replayJournal(oldJournalPath, false);
+    replayJournal(journalPath, true);
+    restoreDone();
+    syncedLsn = lsn;
+    startupMs = ms_since(start);
+
+    fd = open_append(journalPath);
+    if (fd < 0) {
+        std::cerr << "Log store: cannot open " << journalPath << " for writing" << std::endl;
+        std::abort();
+    }
+    if (opts.sync == JournalOptions::Sync::Interval) syncer = std::thread(&LogStore::syncLoop, this);
+    if (opts.snapshotIntervalSec > 0) snapshotter = std::thread(&LogStore::snapshotLoop, this);
+}
+
+LogStore::~LogStore()
+{
+    {
+        std::lock_guard<std::mutex> lock(stopMtx);
+        stopping = true;
+    }
+    stopCv.notify_all();
+    if (syncer.joinable()) syncer.join();
+    if (snapshotter.joinable()) snapshotter.join();
+    if (opts.sync != JournalOptions::Sync::Never) syncTo(lsn);
+    close_fd(fd);
+}
+
+// Вызывается под writeMtx и блокировками шардов пакета, поэтому записи
+// журнала идут в порядке версий. Изменения с result > 0 получили версии
+// подряд, последняя — lastChangeVersion().
+uint64_t LogStore::persist(const Mutation* items, size_t count)
+{
+    uint32_t changed = 0;
+    for (size_t i = 0; i < count; ++i) changed += items[i].result > 0 ? 1 : 0;
+    long long version = lastChangeVersion() - changed;
+
+    record.assign(2 * sizeof(uint32_t), '\0');
+    uint64_t next = lsn + 1;
+    put(record, next);
+    put(record, changed);
+    for (size_t i = 0; i < count; ++i) {
+        const Mutation& m = items[i];
+        if (m.result <= 0) continue;
+        // Задача, удалённая позже в том же пакете, пишется удалённой:
+        // итог проигрывания от этого не меняется
+        const Task* t = m.kind == Mutation::Kind::Delete ? nullptr : findLocked(m.id);
+        put_entry(record, m.id, ++version, t);
+    }
+    uint32_t len = (uint32_t)(record.size() - 2 * sizeof(uint32_t));
+    uint32_t crc = checksum(record.data() + 2 * sizeof(uint32_t), len);
+    std::memcpy(&record[0], &len, sizeof(len));
+    std::memcpy(&record[sizeof(len)], &crc, sizeof(crc));
+
+    if (!write_all(fd, record.data(), record.size())) {
+        std::cerr << "Log store: write to " << journalPath << " failed, stopping" << std::endl;
+        std::abort();
+    }
+    // Только теперь запись целиком в файле и её может покрыть fsync
+    lsn = next;
+    journalBytes += (long long)record.size();
+    journalRecords++;
+    return opts.sync == JournalOptions::Sync::Always ? next : 0;
+}
+
+void LogStore::waitDurable(uint64_t ticket)
+{
+    syncTo(ticket);
+}
+
+// Групповая фиксация: поток, заставший syncing == false, становится ведущим
+// и делает fsync за всех, кто к этому моменту дописал записи; остальные
+// ждут его результата и, если их запись не попала в этот fsync, следующего.
+void LogStore::syncTo(uint64_t target)
+{
+    std::unique_lock<std::mutex> lock(syncMtx);
+    while (syncedLsn < target) {
+        if (syncing) {
+            syncCv.wait(lock);
+            continue;
+        }
+        syncing = true;
+        uint64_t upTo = lsn;
+        int f = fd;
+        lock.unlock();
+        bool ok = sync_fd(f);
+        lock.lock();
+        syncing = false;
+        if (!ok) {
+            std::cerr << "Log store: fsync of " << journalPath << " failed, stopping" << std::endl;
+            std::abort();
+        }
+        fsyncs++;
+        if (upTo > syncedLsn) syncedLsn = upTo;
+        syncCv.notify_all();
+    }
+}
+
+void LogStore::syncLoop()
+{
+    std::unique_lock<std::mutex> lock(stopMtx);
+    while (!stopCv.wait_for(lock, std::chrono::milliseconds(opts.syncIntervalMs), [this] { return stopping; })) {
+        lock.unlock();
+        syncTo(lsn);
+        lock.lock();
+    }
+}
+
+void LogStore::snapshotLoop()
+{
+    std::unique_lock<std::mutex> lock(stopMtx);
+    while (!stopCv.wait_for(lock, std::chrono::seconds(opts.snapshotIntervalSec), [this] { return stopping; })) {
+        lock.unlock();
+        snapshot();
+        lock.lock();
+    }
+}
+
+bool LogStore::snapshot()
+{
+    auto start = std::chrono::steady_clock::now();
+    uint64_t startLsn;
+    {
+        std::lock_guard<std::mutex> writes(writeMtx);
+        if (lsn == snapshotLsn) return true;
+        startLsn = lsn;
+
+        // Записи до startLsn уходят в старый журнал. Если он остался от
+        // неудачного снимка, журнал не переключается: его записи до
+        // startLsn при запуске пропустятся по lsn.
+        if (!file_exists(oldJournalPath)) {
+            // Новых записей под writeMtx нет; дожидаемся идущего fsync и
+            // сбрасываем старый файл сами, закрывая его последние записи
+            std::unique_lock<std::mutex> lock(syncMtx);
+            syncCv.wait(lock, [this] { return !syncing; });
+            if (opts.sync != JournalOptions::Sync::Never) {
+                if (!sync_fd(fd)) {
+                    std::cerr << "Log store: fsync of " << journalPath << " failed, stopping" << std::endl;
+                    std::abort();
+                }
+                fsyncs++;
+                syncedLsn = lsn;
+                syncCv.notify_all();
+            }
+            close_fd(fd);
+            bool moved = replace_file(journalPath, oldJournalPath);
+            fd = open_append(journalPath);
+            if (fd < 0) {
+                std::cerr << "Log store: cannot reopen " << journalPath << ", stopping" << std::endl;
+                std::abort();
+            }
+            if (moved) journalBytes = 0;
+        }
+    }
+
+    std::string tmpPath = snapshotPath + ".tmp";
+    int out = open_truncate(tmpPath);
+    bool ok = out >= 0;
+    uint32_t crc = 0;
+    uint64_t count = 0;
+    std::string buf;
+    auto flush = [&]() {
+        crc = checksum(buf.data(), buf.size(), crc);
+        ok = ok && write_all(out, buf.data(), buf.size());
+        buf.clear();
+    };
+
+    buf.append(kSnapshotMagic, sizeof(kSnapshotMagic));
+    put(buf, kSnapshotFormat);
+    put(buf, startLsn);
+    for (size_t i = 0; i < shardCount() && ok; ++i) {
+        forEachEntry(i, [&](int id, long long version, const Task* t) {
+            put_entry(buf, id, version, t);
+            count++;
+            });
+        if (buf.size() >= kWriteChunk) flush();
+    }
+    put(buf, (int32_t)lastIssuedId());
+    put(buf, count);
+    flush();
+    put(buf, crc);
+    ok = ok && write_all(out, buf.data(), buf.size());
+
+    // Снимок может содержать изменения, записанные в журнал после startLsn:
+    // журнал сбрасывается на диск раньше, чем снимок станет видимым
+    syncTo(lsn);
+    ok = ok && sync_fd(out);
+    if (out >= 0) close_fd(out);
+    ok = ok && replace_file(tmpPath, snapshotPath);
+    if (!ok) {
+        std::cerr << "Log store: cannot write snapshot " << snapshotPath << std::endl;
+        std::remove(tmpPath.c_str());
+        snapshotFailures++;
+        return false;
+    }
+
+    std::remove(oldJournalPath.c_str());
+    snapshotLsn = startLsn;
+    snapshots++;
+    lastSnapshotMs = ms_since(start);
+    return true;
+}
+
+nlohmann::json LogStore::stats()
+{
+    nlohmann::json s = MemoryStore::stats();
+    const char* sync = opts.sync == JournalOptions::Sync::Always ? "always"
+        : opts.sync == JournalOptions::Sync::Interval ? "interval" : "never";
+    s["lsn"] = lsn.load();
+    s["journal"] = {
+        { "fsync", sync },
+        { "bytes", journalBytes.load() },
+        { "records", journalRecords.load() },
+        { "fsyncs", fsyncs.load() }
+    };
+    s["snapshot"] = {
+        { "lsn", snapshotLsn.load() },
+        { "written", snapshots.load() },
+        { "failed", snapshotFailures.load() },
+        { "last_ms", lastSnapshotMs.load() }
+    };
+    s["startup"] = {
+        { "ms", startupMs },
+        { "replayed_records", replayedRecords }
+    };
+    return s;
+}
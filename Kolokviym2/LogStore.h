@@ -0,0 +1,106 @@
+#ifndef LOG_STORE_H
+#define LOG_STORE_H
+
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+
+#include "json.hpp"
+#include "MemoryStore.h"
+
+struct JournalOptions
+{
+    // Always — fsync перед ответом на каждый пакет, Interval — фоновым потоком раз
+    // в syncIntervalMs, Never — сброс на диск остаётся за ОС
+    enum class Sync { Always, Interval, Never };
+
+    Sync sync = Sync::Always;
+    unsigned syncIntervalMs = 100;
+
+    // 0 — снимки не пишутся, журнал растёт без ограничений
+    unsigned snapshotIntervalSec = 60;
+};
+
+// Хранилище в памяти (MemoryStore) плюс двоичный журнал на диске, в который
+// только дописывают. Запись журнала — пакет изменений в виде конечных
+// состояний задач: id, версия журнала изменений и задача целиком либо
+// признак удаления. Запись дописывается после применения пакета в памяти,
+// пока держатся блокировки; fsync в режиме Always делается уже после их
+// снятия, но до ответа клиенту, и один fsync подтверждает пакеты всех
+// потоков, успевших дописать свои записи (групповая фиксация). Если запись
+// или fsync не удались, процесс останавливается (fail-stop), чтобы
+// состояние в памяти не разошлось с диском.
+//
+// Фоновый поток раз в snapshotIntervalSec пишет снимок: переключает журнал
+// на новый файл и, не останавливая записи, обходит шарды по одному. Снимок
+// поэтому «размытый», но записи журнала идемпотентны (запись не новее уже
+// известной версии задачи пропускается), и проигрывание хвоста журнала
+// поверх снимка даёт точное состояние. После снимка старый журнал удаляется.
+//
+// При запуске снимок отображается в память (mmap) и разбирается без копии
+// файла, затем проигрываются только записи журнала новее снимка.
+// Недописанная последняя запись (сбой посреди записи) отрезается;
+// с повреждённым снимком процесс не запускается.
+// Числа пишутся в порядке байтов машины; файлы не переносимы между
+// архитектурами с разным порядком байтов.
+class LogStore : public MemoryStore
+{
+    JournalOptions opts;
+    std::string journalPath;
+    std::string oldJournalPath;
+    std::string snapshotPath;
+
+    // Журнал пишется под writeMtx; lsn — номер последней целиком
+    // дописанной записи. syncMtx защищает syncedLsn и syncing: пока идёт
+    // fsync, дескриптор не закрывается переключением журнала.
+    int fd = -1;
+    std::atomic<uint64_t> lsn{ 0 };
+    std::string record;
+    std::mutex syncMtx;
+    std::condition_variable syncCv;
+    uint64_t syncedLsn = 0;
+    bool syncing = false;
+
+    std::atomic<uint64_t> snapshotLsn{ 0 };
+    std::atomic<long long> journalBytes{ 0 };
+    std::atomic<long long> journalRecords{ 0 };
+    std::atomic<long long> fsyncs{ 0 };
+    std::atomic<long long> snapshots{ 0 };
+    std::atomic<long long> snapshotFailures{ 0 };
+    std::atomic<long long> lastSnapshotMs{ 0 };
+    long long replayedRecords = 0;
+    long long startupMs = 0;
+
+    std::mutex stopMtx;
+    std::condition_variable stopCv;
+    bool stopping = false;
+    std::thread syncer;
+    std::thread snapshotter;
+
+    bool loadSnapshot();
+    void replayJournal(const std::string& path, bool truncateTail);
+    void syncTo(uint64_t target);
+    void syncLoop();
+    void snapshotLoop();
+
+protected:
+    uint64_t persist(const Mutation* items, size_t count) override;
+    void waitDurable(uint64_t ticket) override;
+
+public:
+    // Файлы: base.journal, base.journal.old (до завершения снимка) и base.snapshot
+    explicit LogStore(const std::string& base, JournalOptions opts = JournalOptions());
+    ~LogStore();
+
+    const char* name() const override { return "log"; }
+
+    // Пишет снимок немедленно; false при ошибке
+    bool snapshot();
+
+    nlohmann::json stats() override;
+};
+
+#endif // LOG_STORE_H
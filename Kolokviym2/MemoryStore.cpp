@@ -0,0 +1,514 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "MemoryStore.h"
+
+#include <algorithm>
+#include <cctype>
+#include <mutex>
+
+namespace {
+
+struct Word
+{
+    size_t begin;
+    size_t end;
+    std::string folded;
+};
+
+// Слова текста в нижнем регистре. Словом считается последовательность букв,
+// цифр и любых не-ASCII символов; регистр сворачивается у латиницы и
+// кириллицы в UTF-8, как у токенизатора unicode61.
+std::vector<Word> split_words(const std::string& text)
+{
+    std::vector<Word> words;
+    size_t i = 0;
+    while (i < text.size()) {
+        while (i < text.size() && (unsigned char)text[i] < 0x80 && !std::isalnum((unsigned char)text[i])) ++i;
+        if (i == text.size()) break;
+
+        Word w{ i, i, std::string() };
+        while (i < text.size() && ((unsigned char)text[i] >= 0x80 || std::isalnum((unsigned char)text[i]))) {
+            unsigned char c = (unsigned char)text[i];
+            unsigned char next = i + 1 < text.size() ? (unsigned char)text[i + 1] : 0;
+            if (c == 0xD0 && next >= 0x90 && next <= 0x9F) {
+                w.folded += (char)0xD0;
+                w.folded += (char)(next + 0x20);
+                i += 2;
+            }
+            else if (c == 0xD0 && next >= 0xA0 && next <= 0xAF) {
+                w.folded += (char)0xD1;
+                w.folded += (char)(next - 0x20);
+                i += 2;
+            }
+            else if (c == 0xD0 && next == 0x81) {
+                w.folded += "\xD1\x91";
+                i += 2;
+            }
+            else {
+                w.folded += (char)std::tolower(c);
+                ++i;
+            }
+        }
+        w.end = i;
+        words.push_back(std::move(w));
+    }
+    return words;
+}
+
+struct Term
+{
+    std::string text;
+    bool prefix;
+};
+
+bool term_matches(const Term& t, const std::string& word)
+{
+    return t.prefix ? word.compare(0, t.text.size(), t.text) == 0 : word == t.text;
+}
+
+// Слова запроса режутся тем же токенизатором; * относится к последней части
+std::vector<Term> parse_terms(const std::vector<std::string>& query)
+{
+    std::vector<Term> terms;
+    for (std::string q : query) {
+        bool prefix = !q.empty() && q.back() == '*';
+        if (prefix) q.pop_back();
+        std::vector<Word> words = split_words(q);
+        for (size_t i = 0; i < words.size(); ++i) {
+            terms.push_back({ std::move(words[i].folded), prefix && i + 1 == words.size() });
+        }
+    }
+    return terms;
+}
+
+// Аналог snippet(..., '<b>', '</b>', '...', 12): до 12 слов вокруг первого
+// совпадения, совпавшие слова выделены
+std::string make_snippet(const std::string& text, const std::vector<Word>& words, const std::vector<Term>& terms)
+{
+    const size_t kWords = 12;
+    auto matches = [&](const Word& w) {
+        return std::any_of(terms.begin(), terms.end(), [&](const Term& t) { return term_matches(t, w.folded); });
+    };
+
+    size_t first = 0;
+    while (first < words.size() && !matches(words[first])) ++first;
+    if (first == words.size()) first = 0;
+    size_t from = first > 2 ? first - 2 : 0;
+    if (words.size() > kWords && from + kWords > words.size()) from = words.size() - kWords;
+    size_t to = std::min(words.size(), from + kWords);
+
+    std::string out;
+    if (from > 0) out += "...";
+    size_t pos = from > 0 ? words[from].begin : 0;
+    for (size_t i = from; i < to; ++i) {
+        out.append(text, pos, words[i].begin - pos);
+        bool hit = matches(words[i]);
+        if (hit) out += "<b>";
+        out.append(text, words[i].begin, words[i].end - words[i].begin);
+        if (hit) out += "</b>";
+        pos = words[i].end;
+    }
+    if (to < words.size()) out += "...";
+    else out.append(text, pos, std::string::npos);
+    return out;
+}
+
+
+// k-путевое слияние отсортированных диапазонов [first, second) по ключу key.
+// onItem получает элементы по возрастанию ключа, пока не вернёт false.
+template <class It, class Key, class F>
+void merge_ranges(std::vector<std::pair<It, It>>& ranges, Key key, F onItem)
+{
+    auto greater = [&](size_t a, size_t b) { return key(*ranges[a].first) > key(*ranges[b].first); };
+    std::vector<size_t> heap;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        if (ranges[i].first != ranges[i].second) heap.push_back(i);
+    }
+    std::make_heap(heap.begin(), heap.end(), greater);
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), greater);
+        size_t i = heap.back();
+        if (!onItem(*ranges[i].first)) return;
+        if (++ranges[i].first != ranges[i].second) std::push_heap(heap.begin(), heap.end(), greater);
+        else heap.pop_back();
+    }
+}
+
+} // namespace
+
+const size_t MemoryStore::kShards;
+
+void MemoryStore::Shard::index(const Task& t)
+{
+    idsByStatus[t.status].insert(t.id);
+}
+
+void MemoryStore::Shard::unindex(const Task& t)
+{
+    auto it = idsByStatus.find(t.status);
+    if (it == idsByStatus.end()) return;
+    it->second.erase(t.id);
+    if (it->second.empty()) idsByStatus.erase(it);
+}
+
+void MemoryStore::Shard::recordChange(int id, long long version)
+{
+    auto it = lastChange.find(id);
+    if (it != lastChange.end()) changes.erase(it->second);
+    changes[version] = id;
+    lastChange[id] = version;
+}
+
+MemoryStore::ReadAll::ReadAll(MemoryStore& s)
+{
+    locks.reserve(kShards);
+    for (Shard& shard : s.shards) locks.emplace_back(shard.mtx);
+}
+
+// Вызывается под исключительной блокировкой шарда задачи. Версия журнала
+// выдаётся тоже под ней: обход журнала ждёт все шарды, поэтому не увидит
+// версию N+1 раньше, чем будет применена версия N.
+void MemoryStore::apply(Mutation& op)
+{
+    Shard& s = shardFor(op.id);
+    op.existed = false;
+    op.result = 0;
+    if (op.kind == Mutation::Kind::Insert) {
+        op.task.id = op.id;
+        op.result = op.id;
+        s.index(op.task);
+        s.tasks[op.id] = op.task;
+        s.recordChange(op.id, ++changeVersion);
+        total++;
+        return;
+    }
+
+    auto it = s.tasks.find(op.id);
+    if (it == s.tasks.end()) return;
+    op.existed = true;
+    op.oldStatus = it->second.status;
+    op.result = 1;
+    s.unindex(it->second);
+
+    switch (op.kind) {
+    case Mutation::Kind::UpdateFull:
+        op.task.id = op.id;
+        it->second = op.task;
+        break;
+    case Mutation::Kind::UpdateStatus:
+        it->second.status = op.task.status;
+        break;
+    case Mutation::Kind::Delete:
+        s.tasks.erase(it);
+        s.recordChange(op.id, ++changeVersion);
+        total--;
+        return;
+    default:
+        break;
+    }
+    s.index(it->second);
+    s.recordChange(op.id, ++changeVersion);
+}
+
+uint64_t MemoryStore::persist(const Mutation*, size_t)
+{
+    return 0;
+}
+
+void MemoryStore::waitDurable(uint64_t)
+{
+}
+
+void MemoryStore::commit(Mutation* items, size_t count)
+{
+    uint64_t ticket = 0;
+    {
+        std::unique_lock<std::mutex> ordered(writeMtx, std::defer_lock);
+        if (serializeWrites) ordered.lock();
+
+        // Пока вставка не заблокировала шард своего id, следующий id не
+        // выдаётся. Иначе id N+1 мог бы стать виден раньше N, и страница
+        // после after_id = N+1 навсегда пропустила бы N; читатели же берут
+        // все шарды сразу (ReadAll) и видят вставки только по порядку.
+        std::unique_lock<std::mutex> ids(idMtx, std::defer_lock);
+        bool touched[kShards] = {};
+        for (size_t i = 0; i < count; ++i) {
+            if (items[i].kind == Mutation::Kind::Insert) {
+                if (!ids.owns_lock()) ids.lock();
+                items[i].id = ++lastId;
+            }
+            touched[(unsigned)items[i].id % kShards] = true;
+        }
+        // Шарды блокируются в порядке индексов, как и в ReadAll
+        std::unique_lock<std::shared_timed_mutex> locks[kShards];
+        for (size_t i = 0; i < kShards; ++i) {
+            if (touched[i]) locks[i] = std::unique_lock<std::shared_timed_mutex>(shards[i].mtx);
+        }
+        if (ids.owns_lock()) ids.unlock();
+
+        bool changed = false;
+        for (size_t i = 0; i < count; ++i) {
+            apply(items[i]);
+            changed = changed || items[i].result > 0;
+        }
+        if (changed) {
+            ticket = persist(items, count);
+            version++;
+        }
+        // Слушатель вызывается под блокировками, чтобы видеть изменения
+        // в порядке версий
+        if (changeListener) {
+            for (size_t i = 0; i < count; ++i) {
+                if (items[i].result > 0) changeListener(items[i]);
+            }
+        }
+    }
+    if (ticket != 0) waitDurable(ticket);
+}
+
+const Task* MemoryStore::findLocked(int id)
+{
+    Shard& s = shardFor(id);
+    auto it = s.tasks.find(id);
+    return it == s.tasks.end() ? nullptr : &it->second;
+}
+
+void MemoryStore::restorePut(const Task& t, long long changeVersion)
+{
+    Shard& s = shardFor(t.id);
+    std::unique_lock<std::shared_timed_mutex> lock(s.mtx);
+    auto seen = s.lastChange.find(t.id);
+    if (seen != s.lastChange.end() && seen->second >= changeVersion) return;
+
+    auto it = s.tasks.find(t.id);
+    if (it != s.tasks.end()) {
+        s.unindex(it->second);
+        it->second = t;
+    }
+    else {
+        s.tasks[t.id] = t;
+        total++;
+    }
+    s.index(t);
+    s.recordChange(t.id, changeVersion);
+    restoreLastId(t.id);
+    if (changeVersion > this->changeVersion) this->changeVersion = changeVersion;
+}
+
+void MemoryStore::restoreDelete(int id, long long changeVersion)
+{
+    Shard& s = shardFor(id);
+    std::unique_lock<std::shared_timed_mutex> lock(s.mtx);
+    auto seen = s.lastChange.find(id);
+    if (seen != s.lastChange.end() && seen->second >= changeVersion) return;
+
+    auto it = s.tasks.find(id);
+    if (it != s.tasks.end()) {
+        s.unindex(it->second);
+        s.tasks.erase(it);
+        total--;
+    }
+    s.recordChange(id, changeVersion);
+    restoreLastId(id);
+    if (changeVersion > this->changeVersion) this->changeVersion = changeVersion;
+}
+
+void MemoryStore::restoreLastId(int id)
+{
+    if (id > lastId) lastId = id;
+}
+
+void MemoryStore::forEachEntry(size_t shard, const std::function<void(int, long long, const Task*)>& onEntry)
+{
+    Shard& s = shards[shard];
+    std::shared_lock<std::shared_timed_mutex> lock(s.mtx);
+    for (const auto& entry : s.lastChange) {
+        auto it = s.tasks.find(entry.first);
+        onEntry(entry.first, entry.second, it == s.tasks.end() ? nullptr : &it->second);
+    }
+}
+
+void MemoryStore::addTask(Task& t)
+{
+    Mutation op{ Mutation::Kind::Insert, 0, t };
+    commit(&op, 1);
+    t.id = (int)op.result;
+}
+
+bool MemoryStore::applyBatch(std::vector<Mutation>& items)
+{
+    if (!items.empty()) commit(items.data(), items.size());
+    return true;
+}
+
+std::pair<bool, Task> MemoryStore::getOne(int id)
+{
+    Shard& s = shardFor(id);
+    std::shared_lock<std::shared_timed_mutex> lock(s.mtx);
+    auto it = s.tasks.find(id);
+    if (it == s.tasks.end()) return { false, Task() };
+    return { true, it->second };
+}
+
+bool MemoryStore::updateStatus(int id, std::string status)
+{
+    Mutation op{ Mutation::Kind::UpdateStatus, id };
+    op.task.status = std::move(status);
+    commit(&op, 1);
+    return op.result > 0;
+}
+
+bool MemoryStore::updateFull(int id, const Task& t)
+{
+    Mutation op{ Mutation::Kind::UpdateFull, id, t };
+    commit(&op, 1);
+    return op.result > 0;
+}
+
+bool MemoryStore::deleteTask(int id)
+{
+    Mutation op{ Mutation::Kind::Delete, id };
+    commit(&op, 1);
+    return op.result > 0;
+}
+
+std::vector<Task> MemoryStore::getAll()
+{
+    ReadAll lock(*this);
+    std::vector<Task> results;
+    results.reserve((size_t)total.load());
+    std::vector<std::pair<std::map<int, Task>::const_iterator, std::map<int, Task>::const_iterator>> ranges;
+    for (const Shard& s : shards) ranges.push_back({ s.tasks.begin(), s.tasks.end() });
+    merge_ranges(ranges, [](const std::pair<const int, Task>& e) { return e.first; }, [&](const std::pair<const int, Task>& e) {
+        results.push_back(e.second);
+        return true;
+        });
+    return results;
+}
+
+int MemoryStore::forEachAfter(int afterId, int limit, const std::string& status,
+    const std::function<void(const TaskView&)>& onRow)
+{
+    ReadAll lock(*this);
+    int rows = 0;
+    if (limit <= 0) return rows;
+    if (status.empty()) {
+        std::vector<std::pair<std::map<int, Task>::const_iterator, std::map<int, Task>::const_iterator>> ranges;
+        for (const Shard& s : shards) ranges.push_back({ s.tasks.upper_bound(afterId), s.tasks.end() });
+        merge_ranges(ranges, [](const std::pair<const int, Task>& e) { return e.first; }, [&](const std::pair<const int, Task>& e) {
+            onRow(TaskView(e.second));
+            return ++rows < limit;
+            });
+        return rows;
+    }
+
+    std::vector<std::pair<std::set<int>::const_iterator, std::set<int>::const_iterator>> ranges;
+    for (const Shard& s : shards) {
+        auto ids = s.idsByStatus.find(status);
+        if (ids != s.idsByStatus.end()) ranges.push_back({ ids->second.upper_bound(afterId), ids->second.end() });
+    }
+    merge_ranges(ranges, [](int id) { return id; }, [&](int id) {
+        onRow(TaskView(shardFor(id).tasks.at(id)));
+        return ++rows < limit;
+        });
+    return rows;
+}
+
+int MemoryStore::search(const std::vector<std::string>& query, int limit, bool snippet,
+    const std::function<void(const Task&, const std::string&)>& onRow)
+{
+    std::vector<Term> terms = parse_terms(query);
+    if (terms.empty()) return 0;
+
+    ReadAll lock(*this);
+    // Каждое слово запроса должно встретиться хотя бы раз, как в FTS5 MATCH
+    std::vector<std::pair<long long, const Task*>> hits;
+    for (const Shard& s : shards) {
+        for (const auto& entry : s.tasks) {
+            std::vector<Word> title = split_words(entry.second.title);
+            std::vector<Word> desc = split_words(entry.second.description);
+            long long score = 0;
+            bool all = true;
+            for (const Term& t : terms) {
+                long long n = 0;
+                for (const Word& w : title) n += term_matches(t, w.folded) ? 10 : 0;
+                for (const Word& w : desc) n += term_matches(t, w.folded) ? 1 : 0;
+                if (n == 0) {
+                    all = false;
+                    break;
+                }
+                score += n;
+            }
+            if (all) hits.push_back({ score, &entry.second });
+        }
+    }
+
+    size_t n = std::min(hits.size(), (size_t)std::max(limit, 0));
+    std::partial_sort(hits.begin(), hits.begin() + n, hits.end(), [](const std::pair<long long, const Task*>& a, const std::pair<long long, const Task*>& b) {
+        return a.first != b.first ? a.first > b.first : a.second->id < b.second->id;
+        });
+
+    std::string text;
+    for (size_t i = 0; i < n; ++i) {
+        const Task& t = *hits[i].second;
+        if (snippet) {
+            std::vector<Word> title = split_words(t.title);
+            bool inTitle = std::any_of(title.begin(), title.end(), [&](const Word& w) {
+                return std::any_of(terms.begin(), terms.end(), [&](const Term& term) { return term_matches(term, w.folded); });
+                });
+            text = inTitle ? make_snippet(t.title, title, terms) : make_snippet(t.description, split_words(t.description), terms);
+        }
+        onRow(t, text);
+    }
+    return (int)n;
+}
+
+int MemoryStore::forEachChangeSince(long long since, int limit,
+    const std::function<void(const TaskChange&)>& onRow)
+{
+    ReadAll lock(*this);
+    TaskChange c;
+    int rows = 0;
+    if (limit <= 0) return rows;
+    std::vector<std::pair<std::map<long long, int>::const_iterator, std::map<long long, int>::const_iterator>> ranges;
+    for (const Shard& s : shards) ranges.push_back({ s.changes.upper_bound(since), s.changes.end() });
+    merge_ranges(ranges, [](const std::pair<const long long, int>& e) { return e.first; }, [&](const std::pair<const long long, int>& e) {
+        const Shard& s = shardFor(e.second);
+        auto task = s.tasks.find(e.second);
+        c.version = e.first;
+        c.id = e.second;
+        c.deleted = task == s.tasks.end();
+        c.task = c.deleted ? Task() : task->second;
+        onRow(c);
+        return ++rows < limit;
+        });
+    return rows;
+}
+
+long long MemoryStore::size()
+{
+    return total.load();
+}
+
+TaskCounts MemoryStore::getCounts()
+{
+    ReadAll lock(*this);
+    TaskCounts counts;
+    counts.total = total.load();
+    for (const Shard& s : shards) {
+        for (const auto& entry : s.idsByStatus) counts.byStatus[entry.first] += (long long)entry.second.size();
+    }
+    return counts;
+}
+
+nlohmann::json MemoryStore::stats()
+{
+    ReadAll lock(*this);
+    size_t changes = 0;
+    for (const Shard& s : shards) changes += s.changes.size();
+    return nlohmann::json{
+        { "backend", name() },
+        { "shards", kShards },
+        { "last_id", lastId.load() },
+        { "change_log", changes }
+    };
+}
@@ -0,0 +1,141 @@
+#ifndef MEMORY_STORE_H
+#define MEMORY_STORE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <functional>
+#include <cstdint>
+
+#include "json.hpp"
+#include "TaskStore.h"
+
+// Хранилище только в памяти: всё теряется при остановке сервера.
+// Задачи разложены по шардам по id, у каждого шарда своя блокировка
+// чтения-записи, поэтому точечные чтения и изменения разных задач не
+// ждут друг друга. Id выдаёт атомарный счётчик; как AUTOINCREMENT
+// в SQLite, id удалённой задачи не переиспользуется.
+// Упорядоченные обходы (списки, журнал изменений) держат разделяемые
+// блокировки всех шардов и сливают их k-путевым слиянием, так что видят
+// согласованный снимок: в нём нет пакета, применённого наполовину.
+class MemoryStore : public TaskStore
+{
+    static const size_t kShards = 64;
+
+    struct alignas(64) Shard
+    {
+        mutable std::shared_timed_mutex mtx;
+        std::map<int, Task> tasks;
+        std::unordered_map<std::string, std::set<int>> idsByStatus;
+
+        // Журнал изменений шарда: версия -> id и последняя версия каждого id.
+        // Удалённая задача остаётся в журнале надгробием.
+        std::map<long long, int> changes;
+        std::unordered_map<int, long long> lastChange;
+
+        void index(const Task& t);
+        void unindex(const Task& t);
+        void recordChange(int id, long long version);
+    };
+
+    Shard shards[kShards];
+    std::atomic<int> lastId{ 0 };
+    // Держится от выдачи id вставкам до блокировки их шардов
+    std::mutex idMtx;
+    std::atomic<long long> changeVersion{ 0 };
+    std::atomic<long long> total{ 0 };
+    std::atomic<uint64_t> version{ 1 };
+
+    Shard& shardFor(int id) { return shards[(unsigned)id % kShards]; }
+
+    void apply(Mutation& op);
+
+    // Разделяемые блокировки всех шардов в порядке индексов
+    class ReadAll
+    {
+        std::vector<std::shared_lock<std::shared_timed_mutex>> locks;
+
+    public:
+        explicit ReadAll(MemoryStore& s);
+    };
+
+protected:
+    // Пишущие пакеты идут строго по одному; LogStore включает это, чтобы
+    // порядок записей в журнале совпадал с порядком версий
+    bool serializeWrites = false;
+    std::mutex writeMtx;
+
+    static size_t shardCount() { return kShards; }
+
+    // Вызывается сразу после применения пакета, пока блокировки затронутых
+    // шардов ещё держатся и никто не видел изменений. Каждое изменение
+    // с result > 0 получило очередную версию журнала изменений, последняя
+    // из них — lastChangeVersion(). LogStore пишет здесь пакет в журнал.
+    // Возвращает метку, которую commit() после снятия блокировок передаёт
+    // в waitDurable(); 0 — ждать нечего.
+    virtual uint64_t persist(const Mutation* items, size_t count);
+
+    // Возвращается, когда пакет с меткой ticket надёжно записан. Блокировки
+    // уже сняты, поэтому ожидание диска не задерживает читателей и
+    // следующие пакеты.
+    virtual void waitDurable(uint64_t ticket);
+
+    void commit(Mutation* items, size_t count);
+
+    long long lastChangeVersion() const { return changeVersion.load(); }
+
+    // Задача по id; вызывающий держит блокировку её шарда
+    const Task* findLocked(int id);
+
+    // Восстановление при запуске, до начала обслуживания запросов.
+    // Запись с версией не новее уже известной для этого id пропускается,
+    // поэтому повторное применение безвредно.
+    void restorePut(const Task& t, long long changeVersion);
+    void restoreDelete(int id, long long changeVersion);
+    void restoreLastId(int id);
+    void restoreDone() { version++; }
+
+    // Записи журнала изменений шарда под его разделяемой блокировкой:
+    // id, версия и задача (nullptr для удалённой)
+    void forEachEntry(size_t shard, const std::function<void(int, long long, const Task*)>& onEntry);
+    int lastIssuedId() const { return lastId.load(); }
+
+public:
+    MemoryStore() {}
+    MemoryStore(const MemoryStore&) = delete;
+    MemoryStore& operator=(const MemoryStore&) = delete;
+
+    const char* name() const override { return "memory"; }
+
+    void addTask(Task& t) override;
+    bool applyBatch(std::vector<Mutation>& items) override;
+
+    std::pair<bool, Task> getOne(int id) override;
+    bool updateStatus(int id, std::string status) override;
+    bool updateFull(int id, const Task& t) override;
+    bool deleteTask(int id) override;
+    std::vector<Task> getAll() override;
+
+    int forEachAfter(int afterId, int limit, const std::string& status,
+        const std::function<void(const TaskView&)>& onRow) override;
+
+    // Перебор всех задач: совпадение слова целиком или по префиксу,
+    // слово в названии весит как в FTS5-ранжировании Database (10:1)
+    int search(const std::vector<std::string>& terms, int limit, bool snippet,
+        const std::function<void(const Task&, const std::string&)>& onRow) override;
+    int forEachChangeSince(long long since, int limit,
+        const std::function<void(const TaskChange&)>& onRow) override;
+
+    uint64_t dataVersion() const override { return version.load(); }
+
+    long long size() override;
+    TaskCounts getCounts() override;
+    nlohmann::json stats() override;
+};
+
+#endif // MEMORY_STORE_H
@@ -0,0 +1,164 @@
+#ifndef TASK_STORE_H
+#define TASK_STORE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <utility>
+#include <cstdint>
+
+#include "json.hpp"
+
+struct Task
+{
+    int id = 0;
+    std::string title;
+    std::string description;
+    std::string status = "todo";
+};
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Task, id, title, description, status)
+
+// Задача без копирования строк: указатели смотрят в строку курсора SQLite
+// или в задачу под блокировкой шарда и действительны только внутри
+// колбэка, который её получил
+struct TaskView
+{
+    int id = 0;
+    const char* title = "";
+    size_t titleLen = 0;
+    const char* description = "";
+    size_t descriptionLen = 0;
+    const char* status = "";
+    size_t statusLen = 0;
+
+    TaskView() {}
+    explicit TaskView(const Task& t)
+        : id(t.id), title(t.title.data()), titleLen(t.title.size()),
+        description(t.description.data()), descriptionLen(t.description.size()),
+        status(t.status.data()), statusLen(t.status.size()) {}
+
+    Task toTask() const
+    {
+        return Task{ id, std::string(title, titleLen), std::string(description, descriptionLen), std::string(status, statusLen) };
+    }
+};
+
+// Одно изменение задачи.
+// result: id новой задачи для вставки, число изменённых строк иначе, -1 при ошибке
+struct Mutation
+{
+    enum class Kind { Insert, UpdateFull, UpdateStatus, Delete };
+
+    Kind kind;
+    int id;
+    Task task;
+    long long result = -1;
+
+    // Статус до изменения, нужен для счётчиков /metrics
+    bool existed = false;
+    std::string oldStatus;
+
+    Mutation(Kind kind = Kind::Insert, int id = 0, const Task& task = Task())
+        : kind(kind), id(id), task(task) {}
+};
+
+struct TaskCounts
+{
+    long long total = 0;
+    std::map<std::string, long long> byStatus;
+};
+
+// Запись журнала изменений: последняя версия задачи или надгробие
+// (deleted, task пустая)
+struct TaskChange
+{
+    long long version = 0;
+    int id = 0;
+    bool deleted = false;
+    Task task;
+};
+
+// Хранилище задач, с которым работают обработчики HTTP. Реализации:
+// Database (SQLite), MemoryStore (только память) и LogStore (память
+// плюс журнал на диске); нужная выбирается флагом --store.
+// Колбэки forEach* и search вызываются под блокировками хранилища:
+// в них нельзя обращаться к тому же хранилищу.
+// Статус приходит от клиента как есть; Database хранит каждый новый
+// статус в справочнике навсегда, поэтому и длина, и число статусов ограничены
+const size_t kMaxStatusLength = 32;
+const size_t kMaxStatuses = 64;
+
+// Непустой, не длиннее kMaxStatusLength байт, без управляющих символов
+inline bool valid_status(const std::string& status)
+{
+    if (status.empty() || status.size() > kMaxStatusLength) return false;
+    for (unsigned char c : status) {
+        if (c < 0x20 || c == 0x7f) return false;
+    }
+    return true;
+}
+
+class TaskStore
+{
+protected:
+    // Получает каждое применённое изменение в порядке применения
+    std::function<void(const Mutation&)> changeListener;
+
+public:
+    virtual ~TaskStore() {}
+
+    // Задаётся до того, как сервер начнёт принимать запросы
+    void onChange(std::function<void(const Mutation&)> fn)
+    {
+        changeListener = std::move(fn);
+    }
+
+    virtual const char* name() const = 0;
+
+    // Можно ли записать задачу с таким статусом; проверяется до изменения,
+    // чтобы ответить 400, а не ошибкой записи
+    virtual bool acceptsStatus(const std::string& status) { return valid_status(status); }
+
+    virtual void addTask(Task& t) = 0;
+
+    // Выполняет все изменения атомарно. При ошибке не применяется ни одно
+    // из них и возвращается false; иначе результат каждого изменения
+    // лежит в его result (0 — задача не найдена).
+    virtual bool applyBatch(std::vector<Mutation>& items) = 0;
+
+    virtual std::pair<bool, Task> getOne(int id) = 0;
+    virtual bool updateStatus(int id, std::string status) = 0;
+    virtual bool updateFull(int id, const Task& t) = 0;
+    virtual bool deleteTask(int id) = 0;
+    virtual std::vector<Task> getAll() = 0;
+
+    // Keyset-пагинация: до limit задач с id > afterId по возрастанию id,
+    // с непустым status — только задачи в этом статусе. Возвращает число строк.
+    // Это горячий путь списков, поэтому строки отдаются без копирования.
+    virtual int forEachAfter(int afterId, int limit, const std::string& status,
+        const std::function<void(const TaskView&)>& onRow) = 0;
+
+    // Поиск по названию и описанию: terms — слова запроса, слово с * на
+    // конце ищется как префикс. До limit задач по убыванию релевантности;
+    // со snippet второй аргумент колбэка — фрагмент текста с совпадением.
+    // Возвращает число строк или -1, если поиск недоступен.
+    virtual int search(const std::vector<std::string>& terms, int limit, bool snippet,
+        const std::function<void(const Task&, const std::string&)>& onRow) = 0;
+
+    // Журнал изменений: до limit записей с версией больше since по
+    // возрастанию версии. Возвращает число строк.
+    virtual int forEachChangeSince(long long since, int limit,
+        const std::function<void(const TaskChange&)>& onRow) = 0;
+
+    // Растёт после каждого изменения; основа ETag
+    virtual uint64_t dataVersion() const = 0;
+
+    virtual long long size() = 0;
+    virtual TaskCounts getCounts() = 0;
+
+    // Раздел "store" в /metrics
+    virtual nlohmann::json stats() = 0;
+};
+
+#endif // TASK_STORE_H
@@ -0,0 +1,384 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+// Микробенчмарки слоя хранения: реализации TaskStore напрямую, без HTTP.
+// Аргументы каждого бенчмарка: размер таблицы и хранилище (0 — Database
+// в ":memory:", 1 — Database в файле на диске, 2 — MemoryStore). Размеры
+// от 1k до 10M строк; верхнюю границу можно снизить переменной окружения
+// DB_BENCH_MAX_ROWS. Кроме ns/op печатается allocs/op — число вызовов
+// operator new на операцию, включая поток писателя. BM_Restart меряет
+// запуск LogStore: чтение снимка или проигрывание журнала целиком.
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Database.h"
+#include "MemoryStore.h"
+#include "LogStore.h"
+
+namespace {
+std::atomic<long long> g_allocs{ 0 };
+}
+
+// Встроенные new и delete показали бы GCC malloc() или free() в паре
+// с operator delete или operator new (-Wmismatched-new-delete); без
+// встраивания вызывающий код видит пару new/delete как есть
+#ifdef _MSC_VER
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+BENCH_NOINLINE void* operator new(std::size_t size)
+{
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+BENCH_NOINLINE void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+BENCH_NOINLINE void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+
+enum Storage { Memory = 0, Disk = 1, Sharded = 2 };
+
+const long long kMinRows = 1000;
+const long long kMaxRows = 10000000;
+const size_t kFillBatch = 1000;
+
+long long max_rows()
+{
+    const char* env = std::getenv("DB_BENCH_MAX_ROWS");
+    long long n = env ? std::atoll(env) : kMaxRows;
+    return n >= kMinRows ? n : kMinRows;
+}
+
+void fill(TaskStore& db, long long rows)
+{
+    std::vector<Mutation> batch;
+    for (long long done = 0; done < rows; done += (long long)batch.size()) {
+        size_t n = (size_t)std::min<long long>(kFillBatch, rows - done);
+        batch.assign(n, Mutation{ Mutation::Kind::Insert });
+        for (size_t i = 0; i < n; ++i) {
+            batch[i].task.title = "task " + std::to_string(done + i);
+            batch[i].task.description = "benchmark row";
+        }
+        db.applyBatch(batch);
+    }
+}
+
+// Базы создаются один раз на пару (хранилище, размер) и переиспользуются
+// всеми бенчмарками: заполнение 10M строк дороже самих замеров
+class Fixtures
+{
+    std::mutex mtx;
+    std::map<std::pair<int, long long>, std::unique_ptr<TaskStore>> dbs;
+
+public:
+    ~Fixtures()
+    {
+        for (auto& entry : dbs) {
+            bool disk = entry.first.first == Disk;
+            std::string path = "bench_" + std::to_string(entry.first.second) + ".db";
+            entry.second.reset();
+            if (disk) {
+                std::remove(path.c_str());
+                std::remove((path + "-wal").c_str());
+                std::remove((path + "-shm").c_str());
+            }
+        }
+    }
+
+    TaskStore& get(int storage, long long rows)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto& db = dbs[std::make_pair(storage, rows)];
+        if (db) return *db;
+
+        std::string path = storage == Disk ? "bench_" + std::to_string(rows) + ".db" : ":memory:";
+        if (storage == Disk) {
+            std::remove(path.c_str());
+            std::remove((path + "-wal").c_str());
+            std::remove((path + "-shm").c_str());
+        }
+        if (storage == Sharded) db.reset(new MemoryStore());
+        else db.reset(new Database(path.c_str()));
+        fill(*db, rows);
+        return *db;
+    }
+};
+
+Fixtures& fixtures()
+{
+    static Fixtures f;
+    return f;
+}
+
+// Файлы LogStore для BM_Restart: со снимком журнал пуст, без снимка
+// все задачи лежат в журнале записями по kFillBatch
+class RestartFiles
+{
+    std::mutex mtx;
+    std::set<std::pair<long long, bool>> ready;
+
+    static void remove(const std::string& base)
+    {
+        std::remove((base + ".journal").c_str());
+        std::remove((base + ".journal.old").c_str());
+        std::remove((base + ".snapshot").c_str());
+    }
+
+public:
+    static std::string base(long long rows, bool snapshot)
+    {
+        return "bench_restart_" + std::to_string(rows) + (snapshot ? "_snap" : "_log");
+    }
+
+    ~RestartFiles()
+    {
+        for (auto& entry : ready) remove(base(entry.first, entry.second));
+    }
+
+    std::string prepare(long long rows, bool snapshot)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::string path = base(rows, snapshot);
+        if (!ready.insert(std::make_pair(rows, snapshot)).second) return path;
+
+        remove(path);
+        JournalOptions opts;
+        opts.sync = JournalOptions::Sync::Never;
+        opts.snapshotIntervalSec = 0;
+        LogStore db(path, opts);
+        fill(db, rows);
+        if (snapshot) db.snapshot();
+        return path;
+    }
+};
+
+RestartFiles& restart_files()
+{
+    static RestartFiles f;
+    return f;
+}
+
+// Случайный id из первых rows задач: заполнение выдаёт id подряд с 1
+int random_id(std::mt19937& rng, long long rows)
+{
+    return (int)(rng() % (unsigned long long)rows) + 1;
+}
+
+// allocs/op: глобальный счётчик охватывает и поток писателя. Его снимает
+// только поток 0, а kAvgIterations делит на итерации всех потоков.
+// pause()/resume() исключают подготовку итерации, как PauseTiming()
+class AllocCounter
+{
+    benchmark::State& state;
+    long long start;
+    long long counted = 0;
+    bool running = true;
+
+public:
+    explicit AllocCounter(benchmark::State& s) : state(s), start(g_allocs.load()) {}
+    ~AllocCounter()
+    {
+        pause();
+        long long allocs = state.thread_index() == 0 ? counted : 0;
+        state.counters["allocs/op"] = benchmark::Counter((double)allocs, benchmark::Counter::kAvgIterations);
+    }
+
+    void pause()
+    {
+        if (running) counted += g_allocs.load() - start;
+        running = false;
+    }
+
+    void resume()
+    {
+        start = g_allocs.load();
+        running = true;
+    }
+};
+
+TaskStore& setup(benchmark::State& state)
+{
+    return fixtures().get((int)state.range(1), state.range(0));
+}
+
+// Таблица растёт на число итераций; остальные бенчмарки берут id
+// только из заполненного диапазона, поэтому на них это почти не влияет
+void BM_AddTask(benchmark::State& state)
+{
+    TaskStore& db = setup(state);
+    Task t;
+    t.title = "added";
+    t.description = "benchmark row";
+    {
+        AllocCounter allocs(state);
+        for (auto _ : state) {
+            Task copy = t;
+            db.addTask(copy);
+            benchmark::DoNotOptimize(copy.id);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_GetAll(benchmark::State& state)
+{
+    TaskStore& db = setup(state);
+    size_t rows = 0;
+    {
+        AllocCounter allocs(state);
+        for (auto _ : state) {
+            auto all = db.getAll();
+            rows = all.size();
+            benchmark::DoNotOptimize(all.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * (long long)rows);
+}
+
+void BM_GetOne(benchmark::State& state)
+{
+    TaskStore& db = setup(state);
+    std::mt19937 rng(state.thread_index() + 1);
+    {
+        AllocCounter allocs(state);
+        for (auto _ : state) {
+            auto r = db.getOne(random_id(rng, state.range(0)));
+            benchmark::DoNotOptimize(r.first);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_UpdateStatus(benchmark::State& state)
+{
+    TaskStore& db = setup(state);
+    std::mt19937 rng(state.thread_index() + 1);
+    {
+        AllocCounter allocs(state);
+        for (auto _ : state) {
+            bool ok = db.updateStatus(random_id(rng, state.range(0)), rng() % 2 ? "done" : "todo");
+            benchmark::DoNotOptimize(ok);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_UpdateFull(benchmark::State& state)
+{
+    TaskStore& db = setup(state);
+    std::mt19937 rng(state.thread_index() + 1);
+    Task t;
+    t.title = "updated";
+    t.description = "benchmark row";
+    {
+        AllocCounter allocs(state);
+        for (auto _ : state) {
+            bool ok = db.updateFull(random_id(rng, state.range(0)), t);
+            benchmark::DoNotOptimize(ok);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Удаляется задача, вставленная вне замера, чтобы размер таблицы не менялся
+void BM_DeleteTask(benchmark::State& state)
+{
+    TaskStore& db = setup(state);
+    {
+        AllocCounter allocs(state);
+        for (auto _ : state) {
+            state.PauseTiming();
+            allocs.pause();
+            Task t;
+            t.title = "to delete";
+            db.addTask(t);
+            allocs.resume();
+            state.ResumeTiming();
+            bool ok = db.deleteTask(t.id);
+            benchmark::DoNotOptimize(ok);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Время от открытия файлов до готовности обслуживать запросы; проверка
+// и освобождение задач в замер не входят
+void BM_Restart(benchmark::State& state)
+{
+    long long rows = state.range(0);
+    JournalOptions opts;
+    opts.sync = JournalOptions::Sync::Never;
+    opts.snapshotIntervalSec = 0;
+    std::string path = restart_files().prepare(rows, state.range(1) != 0);
+    for (auto _ : state) {
+        std::unique_ptr<LogStore> db(new LogStore(path, opts));
+        state.PauseTiming();
+        if ((long long)db->getAll().size() != rows) state.SkipWithError("restored row count differs");
+        db.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+
+void TableSizes(benchmark::internal::Benchmark* b)
+{
+    for (int storage : { Memory, Disk, Sharded }) {
+        for (long long rows = kMinRows; rows <= max_rows(); rows *= 10) b->Args({ rows, storage });
+    }
+    b->ArgNames({ "rows", "store" });
+    b->Unit(benchmark::kMicrosecond);
+}
+
+// Конкурентные варианты: потоки делят одно хранилище (у Database — и одного
+// писателя, у MemoryStore — блокировки шардов)
+void Contended(benchmark::internal::Benchmark* b)
+{
+    TableSizes(b);
+    b->ThreadRange(1, 16);
+    b->UseRealTime();
+}
+
+// snapshot:1 — снимок и пустой журнал, snapshot:0 — только журнал
+void RestartSizes(benchmark::internal::Benchmark* b)
+{
+    for (int snapshot : { 1, 0 }) {
+        for (long long rows = kMinRows; rows <= max_rows(); rows *= 10) b->Args({ rows, snapshot });
+    }
+    b->ArgNames({ "rows", "snapshot" });
+    b->Unit(benchmark::kMillisecond);
+}
+
+} // namespace
+
+BENCHMARK(BM_AddTask)->Apply(Contended);
+BENCHMARK(BM_GetAll)->Apply(TableSizes);
+BENCHMARK(BM_GetOne)->Apply(Contended);
+BENCHMARK(BM_UpdateStatus)->Apply(Contended);
+BENCHMARK(BM_UpdateFull)->Apply(Contended);
+BENCHMARK(BM_DeleteTask)->Apply(TableSizes);
+BENCHMARK(BM_Restart)->Apply(RestartSizes);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,338 @@
+#define _CRT_SECURE_NO_WARNINGS
+#pragma warning(disable : 26495)
+
+// Генератор нагрузки для TodoAPI: держит N keep-alive соединений к серверу
+// на localhost, гоняет заданную смесь запросов и печатает пропускную
+// способность и перцентили задержки (текстом и в JSON).
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
+
+#include "httplib.h"
+#include "json.hpp"
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+enum Op { ListOp, GetOp, PostOp, PatchOp, DeleteOp, kOpCount };
+const char* kOpNames[kOpCount] = { "list", "get", "post", "patch", "delete" };
+
+struct Config
+{
+    std::string host = "127.0.0.1";
+    int port = 8081;
+    unsigned connections = 8;
+    double duration = 10;
+    double warmup = 1;
+    double rps = 0;
+    unsigned listLimit = 100;
+    unsigned seedTasks = 1000;
+    unsigned weights[kOpCount] = { 10, 60, 15, 10, 5 };
+    std::string jsonPath;
+};
+
+// Результаты одного соединения; сливаются после остановки
+struct Stats
+{
+    std::vector<long long> latencyUs[kOpCount];
+    long long errors[kOpCount] = {};
+};
+
+// Общий пул id существующих задач для GET/PATCH/DELETE
+class IdPool
+{
+    std::mutex mtx;
+    std::vector<int> ids;
+
+public:
+    void add(int id)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        ids.push_back(id);
+    }
+    bool pick(std::mt19937& rng, bool remove, int& id)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (ids.empty()) return false;
+        size_t i = rng() % ids.size();
+        id = ids[i];
+        if (remove) {
+            ids[i] = ids.back();
+            ids.pop_back();
+        }
+        return true;
+    }
+};
+
+bool is_loopback(const std::string& host)
+{
+    return host == "localhost" || host == "::1" || host.compare(0, 4, "127.") == 0;
+}
+
+// Смесь в виде list:10,get:60,post:15,patch:10,delete:5
+bool parse_mix(const std::string& value, unsigned* weights)
+{
+    unsigned parsed[kOpCount] = {};
+    std::stringstream ss(value);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        size_t colon = item.find(':');
+        if (colon == std::string::npos) return false;
+        std::string name = item.substr(0, colon);
+        int op = -1;
+        for (int i = 0; i < kOpCount; ++i) {
+            if (name == kOpNames[i]) op = i;
+        }
+        if (op < 0) return false;
+        parsed[op] = std::stoul(item.substr(colon + 1));
+    }
+    unsigned total = 0;
+    for (int i = 0; i < kOpCount; ++i) total += parsed[i];
+    if (total == 0) return false;
+    std::copy(parsed, parsed + kOpCount, weights);
+    return true;
+}
+
+bool parse_args(int argc, char** argv, Config& cfg)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return false;
+        }
+        std::string name = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+        try {
+            if (name == "host") cfg.host = value;
+            else if (name == "port") cfg.port = std::stoi(value);
+            else if (name == "connections") cfg.connections = std::stoul(value);
+            else if (name == "duration") cfg.duration = std::stod(value);
+            else if (name == "warmup") cfg.warmup = std::stod(value);
+            else if (name == "rps") cfg.rps = std::stod(value);
+            else if (name == "list-limit") cfg.listLimit = std::stoul(value);
+            else if (name == "seed") cfg.seedTasks = std::stoul(value);
+            else if (name == "json") cfg.jsonPath = value;
+            else if (name == "mix") {
+                if (!parse_mix(value, cfg.weights)) throw std::invalid_argument(value);
+            }
+            else {
+                std::cerr << "Unknown option: --" << name << std::endl;
+                return false;
+            }
+        }
+        catch (const std::exception&) {
+            std::cerr << "Invalid value for --" << name << ": " << value << std::endl;
+            return false;
+        }
+    }
+    if (!is_loopback(cfg.host)) {
+        std::cerr << "Load generator only targets localhost, got: " << cfg.host << std::endl;
+        return false;
+    }
+    if (cfg.connections == 0) cfg.connections = 1;
+    return true;
+}
+
+const std::string kTaskBody = "{\"title\": \"load test\", \"description\": \"generated by loadgen\"}";
+
+// Один запрос; false — ошибка соединения или ответ не 2xx. Без известного
+// id вместо чтения, изменения или удаления создаётся задача, и op
+// становится PostOp, чтобы запрос попал в статистику POST
+bool run_op(httplib::Client& cli, Op& op, IdPool& ids, std::mt19937& rng, const Config& cfg)
+{
+    int id = 0;
+    httplib::Result res;
+    switch (op) {
+    case ListOp:
+        res = cli.Get(cfg.listLimit ? "/tasks?limit=" + std::to_string(cfg.listLimit) : std::string("/tasks"));
+        break;
+    case GetOp:
+        if (!ids.pick(rng, false, id)) return run_op(cli, op = PostOp, ids, rng, cfg);
+        res = cli.Get("/tasks/" + std::to_string(id));
+        break;
+    case PostOp:
+        res = cli.Post("/tasks", kTaskBody, "application/json");
+        if (res && res->status == 201) {
+            try {
+                ids.add(json::parse(res->body).at("id").get<int>());
+            }
+            catch (const std::exception&) {
+                return false;
+            }
+        }
+        break;
+    case PatchOp:
+        if (!ids.pick(rng, false, id)) return run_op(cli, op = PostOp, ids, rng, cfg);
+        res = cli.Patch("/tasks/" + std::to_string(id), rng() % 2 ? "{\"status\": \"done\"}" : "{\"status\": \"todo\"}",
+            "application/json");
+        break;
+    case DeleteOp:
+        if (!ids.pick(rng, true, id)) return run_op(cli, op = PostOp, ids, rng, cfg);
+        // Без тела и Content-Length сервер ждёт тело DELETE до таймаута
+        res = cli.Delete("/tasks/" + std::to_string(id), httplib::Headers{ { "Content-Length", "0" } });
+        break;
+    default:
+        return false;
+    }
+    return res && res->status >= 200 && res->status < 300;
+}
+
+// Соединение работает до stop. С целевым RPS запросы идут по расписанию,
+// и задержка считается от запланированного момента, а не от фактической
+// отправки: иначе тормозящий сервер сам уменьшает нагрузку и прячет хвост.
+void connection_loop(const Config& cfg, unsigned index, IdPool& ids, Clock::time_point measureFrom,
+    Clock::time_point stopAt, Stats& stats)
+{
+    httplib::Client cli(cfg.host, cfg.port);
+    cli.set_keep_alive(true);
+    cli.set_tcp_nodelay(true);
+    std::mt19937 rng(index * 7919u + 1);
+
+    unsigned totalWeight = 0;
+    for (int i = 0; i < kOpCount; ++i) totalWeight += cfg.weights[i];
+
+    auto interval = std::chrono::duration<double>(cfg.rps > 0 ? cfg.connections / cfg.rps : 0);
+    auto next = Clock::now();
+    while (true) {
+        if (cfg.rps > 0) {
+            std::this_thread::sleep_until(next);
+        }
+        auto start = cfg.rps > 0 ? next : Clock::now();
+        if (start >= stopAt) break;
+
+        unsigned r = rng() % totalWeight;
+        int pick = 0;
+        while (r >= cfg.weights[pick]) r -= cfg.weights[pick++];
+
+        Op op = (Op)pick;
+        bool ok = run_op(cli, op, ids, rng, cfg);
+        auto end = Clock::now();
+        if (start >= measureFrom) {
+            stats.latencyUs[op].push_back(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+            if (!ok) stats.errors[op]++;
+        }
+        if (cfg.rps > 0) next += std::chrono::duration_cast<Clock::duration>(interval);
+    }
+}
+
+long long percentile(const std::vector<long long>& sorted, double p)
+{
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+json summarize(std::vector<long long>& lat, long long errors, double seconds)
+{
+    std::sort(lat.begin(), lat.end());
+    long long sum = 0;
+    for (long long v : lat) sum += v;
+    return {
+        {"requests", lat.size()},
+        {"errors", errors},
+        {"rps", lat.size() / seconds},
+        {"mean_us", lat.empty() ? 0.0 : (double)sum / lat.size()},
+        {"p50_us", percentile(lat, 50)},
+        {"p90_us", percentile(lat, 90)},
+        {"p99_us", percentile(lat, 99)},
+        {"p999_us", percentile(lat, 99.9)},
+        {"max_us", lat.empty() ? 0 : lat.back()}
+    };
+}
+
+void print_row(const std::string& name, const json& s)
+{
+    std::printf("%-8s %9lld %7lld %10.1f %9.3f %9.3f %9.3f %9.3f %9.3f\n", name.c_str(),
+        s["requests"].get<long long>(), s["errors"].get<long long>(), s["rps"].get<double>(),
+        s["p50_us"].get<long long>() / 1000.0, s["p90_us"].get<long long>() / 1000.0,
+        s["p99_us"].get<long long>() / 1000.0, s["p999_us"].get<long long>() / 1000.0,
+        s["max_us"].get<long long>() / 1000.0);
+}
+
+int main(int argc, char** argv)
+{
+    Config cfg;
+    if (!parse_args(argc, argv, cfg)) return 1;
+
+    IdPool ids;
+    {
+        httplib::Client cli(cfg.host, cfg.port);
+        cli.set_keep_alive(true);
+        auto probe = cli.Get("/metrics");
+        if (!probe) {
+            std::cerr << "Server is not reachable at " << cfg.host << ":" << cfg.port << std::endl;
+            return 1;
+        }
+        for (unsigned i = 0; i < cfg.seedTasks; ++i) {
+            auto res = cli.Post("/tasks", kTaskBody, "application/json");
+            if (!res || res->status != 201) {
+                std::cerr << "Seeding failed" << std::endl;
+                return 1;
+            }
+            ids.add(json::parse(res->body).at("id").get<int>());
+        }
+    }
+
+    auto begin = Clock::now();
+    auto measureFrom = begin + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(cfg.warmup));
+    auto stopAt = measureFrom + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(cfg.duration));
+
+    std::vector<Stats> stats(cfg.connections);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < cfg.connections; ++i) {
+        threads.emplace_back(connection_loop, std::cref(cfg), i, std::ref(ids), measureFrom, stopAt, std::ref(stats[i]));
+    }
+    for (auto& t : threads) t.join();
+
+    std::vector<long long> all;
+    long long allErrors = 0;
+    json report;
+    report["config"] = {
+        {"host", cfg.host}, {"port", cfg.port}, {"connections", cfg.connections},
+        {"duration_s", cfg.duration}, {"warmup_s", cfg.warmup}, {"target_rps", cfg.rps},
+        {"list_limit", cfg.listLimit}
+    };
+    std::printf("%-8s %9s %7s %10s %9s %9s %9s %9s %9s\n", "op", "requests", "errors", "rps",
+        "p50 ms", "p90 ms", "p99 ms", "p99.9 ms", "max ms");
+    for (int op = 0; op < kOpCount; ++op) {
+        std::vector<long long> lat;
+        long long errors = 0;
+        for (Stats& s : stats) {
+            lat.insert(lat.end(), s.latencyUs[op].begin(), s.latencyUs[op].end());
+            errors += s.errors[op];
+        }
+        if (lat.empty()) continue;
+        all.insert(all.end(), lat.begin(), lat.end());
+        allErrors += errors;
+        json s = summarize(lat, errors, cfg.duration);
+        report["config"]["mix"][kOpNames[op]] = cfg.weights[op];
+        report["ops"][kOpNames[op]] = s;
+        print_row(kOpNames[op], s);
+    }
+    json total = summarize(all, allErrors, cfg.duration);
+    report["total"] = total;
+    print_row("total", total);
+
+    if (!cfg.jsonPath.empty()) {
+        std::ofstream out(cfg.jsonPath);
+        out << report.dump(4) << std::endl;
+        if (!out) {
+            std::cerr << "Cannot write " << cfg.jsonPath << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -1,8 +1,17 @@
 #define _CRT_SECURE_NO_WARNINGS
 #pragma warning(disable : 26495)
+// gzip для ответов; brotli/zstd включаются через CPPHTTPLIB_BROTLI_SUPPORT / CPPHTTPLIB_ZSTD_SUPPORT
+#define CPPHTTPLIB_ZLIB_SUPPORT
 
 #include <iostream>
 #include <vector>
+#include <map>
+#include <list>
+#include <unordered_map>
+#include <cstdint>
+#include <climits>
+#include <ctime>
+#include <sys/stat.h>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -11,290 +20,1939 @@
 #include <memory>
 #include <atomic>
 #include <mutex> 
+#include <condition_variable>
+#include <thread>
+#include <cstring>
+#include <cctype>
+#include <deque>
+#include <cmath>
+#include <future>
+#include <algorithm>
 
-#include "sqlite3.h"
 #include "httplib.h"
 #include "json.hpp"
+#include "TaskStore.h"
+#include "Database.h"
+#include "MemoryStore.h"
+#include "LogStore.h"
 
 using json = nlohmann::json;
 using namespace httplib;
 
-struct Task
+std::atomic<int> total_requests{ 0 };
+
+const int kDefaultPage = 100;
+const int kMaxPage = 1000;
+const int kStreamPage = 500;
+const int kDefaultSearch = 20;
+const int kMaxSearch = 100;
+const size_t kMaxBatchOps = 1000;
+const long long kMaxCachedRows = 50000;
+const size_t kResponseCacheBytes = 32u << 20;
+
+
+// Сериализация задач без промежуточных Task и nlohmann::json: строки пишутся
+// прямо из указателей на колонки в общий буфер. Вывод побайтно совпадает
+// с json(task).dump(): ключи по алфавиту и те же escape-последовательности.
+// Некорректный UTF-8 копируется как есть (dump() в этом случае бросал исключение).
+void append_json_string(std::string& out, const char* s, size_t n)
+{
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    size_t from = 0;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        out.append(s + from, i - from);
+        from = i + 1;
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            out += "\\u00";
+            out += hex[c >> 4];
+            out += hex[c & 0xF];
+        }
+    }
+    out.append(s + from, n - from);
+    out += '"';
+}
+
+void append_task_json(std::string& out, int id, const char* title, size_t titleLen,
+    const char* desc, size_t descLen, const char* status, size_t statusLen)
+{
+    out += "{\"description\":";
+    append_json_string(out, desc, descLen);
+    out += ",\"id\":";
+    out += std::to_string(id);
+    out += ",\"status\":";
+    append_json_string(out, status, statusLen);
+    out += ",\"title\":";
+    append_json_string(out, title, titleLen);
+    out += '}';
+}
+
+void append_task_json(std::string& out, const Task& t)
+{
+    append_task_json(out, t.id, t.title.data(), t.title.size(),
+        t.description.data(), t.description.size(), t.status.data(), t.status.size());
+}
+
+std::string task_json(const Task& t)
 {
-    int id = 0;
+    std::string out;
+    append_task_json(out, t);
+    return out;
+}
+
+
+// Числовой query-параметр; бросает std::invalid_argument при мусоре
+int int_param(const Request& req, const char* name, int def)
+{
+    if (!req.has_param(name)) return def;
+    std::string v = req.get_param_value(name);
+    size_t pos = 0;
+    int n = std::stoi(v, &pos);
+    if (pos != v.size()) throw std::invalid_argument(name);
+    return n;
+}
+
+// Поля тела POST/PUT/PATCH; has* — поле есть и это строка
+struct TaskBody
+{
+    bool hasTitle = false;
+    bool hasDescription = false;
+    bool hasStatus = false;
     std::string title;
     std::string description;
-    std::string status = "todo";
+    std::string status;
+    std::string error;
 };
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Task, id, title, description, status)
 
-std::atomic<int> total_requests{ 0 };
+// SAX-разбор тела задачи без построения json DOM. Семантика та же, что у
+// json::parse + contains/is_string: учитываются только строковые поля
+// верхнего уровня, при повторе ключа побеждает последнее значение,
+// тело не-объект просто не содержит полей. Слишком глубокая вложенность
+// отклоняется сразу.
+class TaskBodyParser : public nlohmann::json_sax<json>
+{
+    enum class Field { None, Title, Description, Status };
+
+    static const int kMaxDepth = 32;
+    TaskBody& body;
+    int depth = 0;
+    bool topObject = false;
+    Field field = Field::None;
+
+    // Значение поля верхнего уровня; str == nullptr — не строка
+    bool value(string_t* str = nullptr)
+    {
+        if (depth != 1 || !topObject || field == Field::None) return true;
+        bool* has = field == Field::Title ? &body.hasTitle : field == Field::Description ? &body.hasDescription : &body.hasStatus;
+        std::string* dst = field == Field::Title ? &body.title : field == Field::Description ? &body.description : &body.status;
+        *has = str != nullptr;
+        if (str) *dst = std::move(*str);
+        field = Field::None;
+        return true;
+    }
+
+    bool open(bool isObject)
+    {
+        value();
+        if (depth == 0) topObject = isObject;
+        if (++depth > kMaxDepth) {
+            body.error = "nesting too deep";
+            return false;
+        }
+        return true;
+    }
+
+public:
+    explicit TaskBodyParser(TaskBody& b) : body(b) {}
+
+    bool null() override { return value(); }
+    bool boolean(bool) override { return value(); }
+    bool number_integer(number_integer_t) override { return value(); }
+    bool number_unsigned(number_unsigned_t) override { return value(); }
+    bool number_float(number_float_t, const string_t&) override { return value(); }
+    bool string(string_t& val) override { return value(&val); }
+    bool binary(binary_t&) override { return value(); }
+
+    bool start_object(std::size_t) override { return open(true); }
+    bool start_array(std::size_t) override { return open(false); }
+    bool end_object() override { --depth; return true; }
+    bool end_array() override { --depth; return true; }
+
+    bool key(string_t& k) override
+    {
+        field = Field::None;
+        if (depth != 1 || !topObject) return true;
+        if (k == "title") field = Field::Title;
+        else if (k == "description") field = Field::Description;
+        else if (k == "status") field = Field::Status;
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override
+    {
+        body.error = ex.what();
+        return false;
+    }
+};
+
+bool parse_task_body(const std::string& text, TaskBody& body)
+{
+    TaskBodyParser parser(body);
+    return json::sax_parse(text, &parser);
+}
+
+// Версия данных живёт только в памяти, поэтому в ETag добавляется время
+// запуска: после рестарта старые ETag клиентов не совпадут с новыми.
+const std::string kEtagPrefix = "\"" + std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + "-";
+
+std::string make_etag(uint64_t version)
+{
+    return kEtagPrefix + std::to_string(version) + "\"";
+}
+
+// Поддерживаемые кодировки в порядке предпочтения
+const char* const kEncodings[] = {
+#ifdef CPPHTTPLIB_BROTLI_SUPPORT
+    "br",
+#endif
+#ifdef CPPHTTPLIB_ZSTD_SUPPORT
+    "zstd",
+#endif
+    "gzip"
+};
+
+// Выбирает кодировку по Accept-Encoding с учётом q=0; пустая строка — без сжатия
+std::string pick_encoding(const Request& req)
+{
+    std::vector<std::string> accepted;
+    std::stringstream ss(req.get_header_value("Accept-Encoding"));
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item.erase(std::remove(item.begin(), item.end(), ' '), item.end());
+        size_t semi = item.find(';');
+        std::string name = item.substr(0, semi);
+        if (semi != std::string::npos) {
+            std::string q = item.substr(semi + 1);
+            if (q.compare(0, 2, "q=") == 0 && std::atof(q.c_str() + 2) <= 0) continue;
+        }
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        accepted.push_back(name);
+    }
+
+    for (const char* enc : kEncodings) {
+        if (std::find(accepted.begin(), accepted.end(), enc) != accepted.end()) return enc;
+    }
+    return "";
+}
+
+// У сжатого и несжатого тела разные байты, поэтому и сильные ETag у них
+// разные: к тегу версии дописывается кодировка ответа
+std::string representation_etag(const Request& req, const std::string& etag)
+{
+    std::string encoding = pick_encoding(req);
+    if (encoding.empty()) return etag;
+    return etag.substr(0, etag.size() - 1) + "-" + encoding + "\"";
+}
+
+// Ставит ETag представления и проверяет If-None-Match; true — можно ответить 304.
+// Vary ответа с телом ставит set_encoding, у 304 тела нет — Vary ставится здесь.
+bool not_modified(const Request& req, Response& res, const std::string& versionEtag)
+{
+    std::string etag = representation_etag(req, versionEtag);
+    res.set_header("ETag", etag);
+    res.set_header("Cache-Control", "no-cache");
+    if (!req.has_header("If-None-Match")) return false;
+
+    std::string header = req.get_header_value("If-None-Match");
+    std::stringstream ss(header);
+    std::string tag;
+    while (std::getline(ss, tag, ',')) {
+        size_t b = tag.find_first_not_of(' ');
+        if (b == std::string::npos) continue;
+        tag = tag.substr(b, tag.find_last_not_of(' ') - b + 1);
+        if (tag.compare(0, 2, "W/") == 0) tag = tag.substr(2);
+        if (tag == "*" || tag == etag) {
+            res.status = 304;
+            res.set_header("Vary", "Accept-Encoding");
+            return true;
+        }
+    }
+    return false;
+}
+
+std::unique_ptr<detail::compressor> make_compressor(const std::string& encoding)
+{
+    std::unique_ptr<detail::compressor> c;
+    if (encoding == "gzip") c.reset(new detail::gzip_compressor());
+#ifdef CPPHTTPLIB_BROTLI_SUPPORT
+    if (encoding == "br") c.reset(new detail::brotli_compressor());
+#endif
+#ifdef CPPHTTPLIB_ZSTD_SUPPORT
+    if (encoding == "zstd") c.reset(new detail::zstd_compressor());
+#endif
+    return c;
+}
 
-std::string get_safe_text(sqlite3_stmt* stmt, int col) {
-    const char* text = (const char*)sqlite3_column_text(stmt, col);
-    return text ? std::string(text) : std::string("");
+std::string compress_body(const std::string& data, const std::string& encoding)
+{
+    std::string out;
+    auto c = make_compressor(encoding);
+    if (!c) return out;
+    c->compress(data.data(), data.size(), true, [&](const char* p, size_t n) {
+        out.append(p, n);
+        return true;
+        });
+    return out;
+}
+
+// Кодировку ответа выбирает только pick_encoding, а сжимает сам сервер.
+// httplib сжимает тела из set_content и чанковые ответы сам, выбирая
+// кодировку поиском подстроки в Accept-Encoding без учёта q, поэтому тела
+// отдаются провайдером с известной длиной: такие ответы httplib не сжимает.
+void set_encoding(Response& res, const std::string& encoding)
+{
+    res.set_header("Vary", "Accept-Encoding");
+    if (!encoding.empty()) res.set_header("Content-Encoding", encoding);
+}
+
+void send_body(const Request& req, Response& res, std::string body, const char* type = "application/json")
+{
+    std::string encoding = pick_encoding(req);
+    set_encoding(res, encoding);
+    if (!encoding.empty()) body = compress_body(body, encoding);
+    auto shared = std::make_shared<const std::string>(std::move(body));
+    res.set_content_provider(shared->size(), type, [shared](size_t offset, size_t length, DataSink& sink) {
+        return sink.write(shared->data() + offset, length);
+        });
 }
 
-class Database
+struct CachedBody
+{
+    uint64_t version = 0;
+    std::string body;
+    std::string nextAfterId;
+};
+
+// Уже сжатые ответы. Ключ — URL и кодировка; запись годится, пока не
+// изменилась версия ресурса, так что один и тот же список не сжимается
+// на каждый запрос.
+class ResponseCache
 {
-    sqlite3* db;
     std::mutex mtx;
+    std::unordered_map<std::string, std::shared_ptr<const CachedBody>> entries;
+    size_t bytes = 0;
+    size_t budget;
 
 public:
-    Database(const char* filename)
+    explicit ResponseCache(size_t budgetBytes) : budget(budgetBytes) {}
+
+    std::shared_ptr<const CachedBody> get(const std::string& key, uint64_t version)
     {
-        sqlite3_open(filename, &db);
-        const char* sql = "CREATE TABLE IF NOT EXISTS tasks ("
-            "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-            "title TEXT NOT NULL,"
-            "description TEXT,"
-            "status TEXT NOT NULL);";
-        sqlite3_exec(db, sql, 0, 0, 0);
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = entries.find(key);
+        if (it == entries.end() || it->second->version != version) return nullptr;
+        return it->second;
     }
-    ~Database() { sqlite3_close(db); }
 
-    void addTask(Task& t)
+    void put(const std::string& key, std::shared_ptr<const CachedBody> entry)
     {
+        if (entry->body.size() > budget) return;
         std::lock_guard<std::mutex> lock(mtx);
-        const char* sql = "INSERT INTO tasks (title, description, status) VALUES (?, ?, ?);";
-        sqlite3_stmt* stmt;
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            bytes -= it->second->body.size();
+            entries.erase(it);
+        }
+        // Сначала выбрасываем устаревшие версии, потом что придётся
+        for (auto e = entries.begin(); e != entries.end() && bytes + entry->body.size() > budget;) {
+            if (e->second->version != entry->version) {
+                bytes -= e->second->body.size();
+                e = entries.erase(e);
+            }
+            else {
+                ++e;
+            }
+        }
+        while (!entries.empty() && bytes + entry->body.size() > budget) {
+            bytes -= entries.begin()->second->body.size();
+            entries.erase(entries.begin());
+        }
+        bytes += entry->body.size();
+        entries[key] = std::move(entry);
+    }
+};
 
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK) {
-            std::cerr << "SQL Error: " << sqlite3_errmsg(db) << std::endl;
-            return;
+// Отдаёт сжатое тело из кэша без копирования
+void send_cached(Response& res, std::shared_ptr<const CachedBody> entry, const std::string& encoding, const char* type)
+{
+    if (!entry->nextAfterId.empty()) res.set_header("X-Next-After-Id", entry->nextAfterId);
+    set_encoding(res, encoding);
+    res.set_content_provider(entry->body.size(), type, [entry](size_t offset, size_t length, DataSink& sink) {
+        return sink.write(entry->body.data() + offset, length);
+        });
+}
+
+// Статический файл в памяти: тело, сжатые варианты, ETag и Last-Modified
+// считаются один раз при загрузке. Файл перечитывается, только если
+// изменился его mtime, а сам mtime проверяется не чаще раза в секунду.
+class StaticAsset
+{
+public:
+    struct Snapshot
+    {
+        bool found = false;
+        time_t mtime = 0;
+        std::string body;
+        std::map<std::string, std::string> encoded;
+        std::string etag;
+        std::string lastModified;
+    };
+
+    StaticAsset(std::string path, const char* type) : path(std::move(path)), type(type) {}
+
+    std::shared_ptr<const Snapshot> get()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto now = std::chrono::steady_clock::now();
+        if (!current || now >= nextCheck) {
+            nextCheck = now + std::chrono::seconds(1);
+            struct stat st;
+            bool exists = stat(path.c_str(), &st) == 0;
+            if (!current || current->found != exists || (exists && current->mtime != st.st_mtime)) {
+                current = load(exists ? st.st_mtime : 0);
+            }
+        }
+        return current;
+    }
+
+    const char* contentType() const { return type; }
+
+private:
+    std::string path;
+    const char* type;
+    std::mutex mtx;
+    std::shared_ptr<const Snapshot> current;
+    std::chrono::steady_clock::time_point nextCheck;
+
+    std::shared_ptr<const Snapshot> load(time_t mtime)
+    {
+        auto s = std::make_shared<Snapshot>();
+        std::ifstream f(path, std::ios::binary);
+        if (!f) return s;
+
+        std::stringstream ss; ss << f.rdbuf();
+        s->found = true;
+        s->mtime = mtime;
+        s->body = ss.str();
+        for (const char* enc : kEncodings) s->encoded[enc] = compress_body(s->body, enc);
+
+        std::stringstream etag;
+        etag << "\"" << std::hex << std::hash<std::string>()(s->body) << "\"";
+        s->etag = etag.str();
+
+        std::tm tm;
+#ifdef _WIN32
+        gmtime_s(&tm, &mtime);
+#else
+        gmtime_r(&mtime, &tm);
+#endif
+        char date[64];
+        std::strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        s->lastModified = date;
+        return s;
+    }
+};
+
+void serve_static(StaticAsset& asset, const Request& req, Response& res)
+{
+    auto snap = asset.get();
+    if (!snap->found) {
+        res.status = 404;
+        send_body(req, res, "Error: index.html not found", "text/plain");
+        return;
+    }
+
+    res.set_header("Last-Modified", snap->lastModified);
+    if (not_modified(req, res, snap->etag)) return;
+    if (!req.has_header("If-None-Match") && req.get_header_value("If-Modified-Since") == snap->lastModified) {
+        res.status = 304;
+        res.set_header("Vary", "Accept-Encoding");
+        return;
+    }
+
+    const std::string* body = &snap->body;
+    std::string encoding = pick_encoding(req);
+    set_encoding(res, encoding);
+    if (!encoding.empty()) body = &snap->encoded.at(encoding);
+    res.set_content_provider(body->size(), asset.contentType(), [snap, body](size_t offset, size_t length, DataSink& sink) {
+        return sink.write(body->data() + offset, length);
+        });
+}
+
+// Строка поиска -> слова запроса. Слово с * на конце ищется как префикс,
+// одиночная * отбрасывается.
+std::vector<std::string> search_terms(const std::string& q)
+{
+    std::vector<std::string> terms;
+    size_t i = 0;
+    while (i < q.size()) {
+        while (i < q.size() && std::isspace((unsigned char)q[i])) ++i;
+        size_t start = i;
+        while (i < q.size() && !std::isspace((unsigned char)q[i])) ++i;
+        if (start == i) break;
+        if (i - start == 1 && q[start] == '*') continue;
+        terms.push_back(q.substr(start, i - start));
+    }
+    return terms;
+}
+
+// Дописывает в out до limit задач с id > lastId (и статусом status, если он
+// задан) через запятую
+int append_tasks(TaskStore& db, const std::string& status, int& lastId, int limit, std::string& out, bool& first)
+{
+    return db.forEachAfter(lastId, limit, status, [&](const TaskView& t) {
+        if (!first) out += ',';
+        first = false;
+        append_task_json(out, t.id, t.title, t.titleLen, t.description, t.descriptionLen, t.status, t.statusLen);
+        lastId = t.id;
+        });
+}
+
+// Разбирает один элемент POST /tasks/batch с теми же правилами, что и у
+// одиночных запросов. Возвращает текст ошибки или пустую строку.
+std::string parse_batch_item(const json& item, Mutation& m)
+{
+    if (!item.is_object() || !item.contains("op") || !item["op"].is_string()) return "Missing op";
+    std::string op = item["op"].get<std::string>();
+
+    auto text = [&](const char* key) {
+        return item.contains(key) && item[key].is_string() ? item[key].get<std::string>() : std::string();
+    };
+    if (op != "create") {
+        if (!item.contains("id") || !item["id"].is_number_integer()) return "Missing id";
+        // get<int>() молча сузил бы 4294967297 до 1, и пакет изменил бы чужую задачу
+        const json& id = item["id"];
+        bool inRange = id.is_number_unsigned()
+            ? id.get<uint64_t>() >= 1 && id.get<uint64_t>() <= (uint64_t)INT_MAX
+            : id.get<long long>() >= 1 && id.get<long long>() <= INT_MAX;
+        if (!inRange) return "Invalid id";
+        m.id = (int)id.get<long long>();
+    }
+
+    if (op == "create") {
+        m.kind = Mutation::Kind::Insert;
+        m.task = Task{ 0, text("title"), text("description"), "todo" };
+        if (m.task.title.empty()) return "Title is empty";
+    }
+    else if (op == "update") {
+        m.kind = Mutation::Kind::UpdateFull;
+        if (!item.contains("title") || !item["title"].is_string()) return "Invalid title";
+        // Как в PUT: без status — "todo", пустой статус отклоняется вызывающим
+        if (item.contains("status") && !item["status"].is_string()) return "Invalid status";
+        m.task = Task{ 0, text("title"), text("description"), item.contains("status") ? text("status") : "todo" };
+    }
+    else if (op == "patch") {
+        m.kind = Mutation::Kind::UpdateStatus;
+        if (!item.contains("status") || !item["status"].is_string()) return "Invalid status";
+        m.task.status = text("status");
+    }
+    else if (op == "delete") {
+        m.kind = Mutation::Kind::Delete;
+    }
+    else {
+        return "Unknown op";
+    }
+    return "";
+}
+
+struct LogRecord
+{
+    std::chrono::system_clock::time_point time;
+    char method[8];
+    char path[112];
+    int status;
+    // -1 — неизвестно, в журнал пишется «-»
+    long long latencyUs;
+    long long bytes;
+};
+
+// Асинхронный журнал запросов. Рабочие потоки кладут записи в кольцевой
+// буфер без блокировок (ограниченная MPMC-очередь Вьюкова), фоновый поток
+// забирает их пачками и пишет одним вызовом с одним flush на пачку.
+// Если буфер полон, запись отбрасывается и учитывается в dropped.
+// Ограничение: httplib вызывает логгер под своим общим logger_mutex_,
+// поэтому push из логгера всё равно идёт по одному. Другого места, где
+// ответ уже отправлен, у httplib нет; под мьютексом делается только
+// заполнение записи и push, без форматирования и вывода.
+class AccessLog
+{
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        LogRecord rec;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{ 0 };
+    alignas(64) std::atomic<size_t> tail{ 0 };
+    unsigned sampleEvery;
+    std::atomic<uint64_t> seen{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::thread drainer;
+
+    bool pop(LogRecord& out)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        Cell& c = cells[pos & mask];
+        size_t seq = c.seq.load(std::memory_order_acquire);
+        if ((std::ptrdiff_t)(seq - (pos + 1)) < 0) return false;
+        out = c.rec;
+        c.seq.store(pos + mask + 1, std::memory_order_release);
+        tail.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    static void format(std::string& out, const LogRecord& r)
+    {
+        std::time_t t = std::chrono::system_clock::to_time_t(r.time);
+        std::tm tm;
+#ifdef _WIN32
+        localtime_s(&tm, &t);
+#else
+        localtime_r(&t, &tm);
+#endif
+        char latency[32] = "-";
+        char bytes[32] = "-";
+        if (r.latencyUs >= 0) std::snprintf(latency, sizeof(latency), "%.3fms", r.latencyUs / 1000.0);
+        if (r.bytes >= 0) std::snprintf(bytes, sizeof(bytes), "%lldB", r.bytes);
+        char line[256];
+        int n = std::snprintf(line, sizeof(line), "[%02d:%02d:%02d] %s %s -> %d %s %s\n",
+            tm.tm_hour, tm.tm_min, tm.tm_sec, r.method, r.path, r.status, latency, bytes);
+        if (n > 0) out.append(line, std::min((size_t)n, sizeof(line) - 1));
+    }
+
+    void drainLoop()
+    {
+        std::string batch;
+        LogRecord rec;
+        for (;;) {
+            bool stop = stopping.load();
+            while (batch.size() < (64u << 10) && pop(rec)) format(batch, rec);
+            if (!batch.empty()) {
+                std::cout.write(batch.data(), batch.size());
+                std::cout.flush();
+                batch.clear();
+                continue;
+            }
+            if (stop) return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
         }
+    }
 
-        sqlite3_bind_text(stmt, 1, t.title.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, t.description.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 3, t.status.c_str(), -1, SQLITE_TRANSIENT);
+public:
+    std::atomic<long long> dropped{ 0 };
 
-        sqlite3_step(stmt);
-        t.id = (int)sqlite3_last_insert_rowid(db);
-        sqlite3_finalize(stmt);
+    // capacity округляется вверх до степени двойки; пишется каждая
+    // sampleEvery-я запись, ответы 5xx пишутся всегда
+    AccessLog(size_t capacity, unsigned sampleEvery)
+        : sampleEvery(sampleEvery ? sampleEvery : 1)
+    {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        cells.reset(new Cell[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; ++i) cells[i].seq.store(i, std::memory_order_relaxed);
+        drainer = std::thread(&AccessLog::drainLoop, this);
+    }
+    ~AccessLog()
+    {
+        stopping = true;
+        drainer.join();
     }
+    AccessLog(const AccessLog&) = delete;
+    AccessLog& operator=(const AccessLog&) = delete;
 
-    std::vector<Task> getAll()
+    void push(const LogRecord& rec)
     {
-        std::lock_guard<std::mutex> lock(mtx);
-        std::vector<Task> results;
-        sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, "SELECT id, title, description, status FROM tasks;", -1, &stmt, 0) != SQLITE_OK) {
-            return results;
+        if (rec.status < 500 && seen++ % sampleEvery != 0) return;
+
+        size_t pos = head.load(std::memory_order_relaxed);
+        Cell* c;
+        for (;;) {
+            c = &cells[pos & mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = (std::ptrdiff_t)(seq - pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) {
+                dropped++;
+                return;
+            }
+            else {
+                pos = head.load(std::memory_order_relaxed);
+            }
         }
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            results.push_back({
-                sqlite3_column_int(stmt, 0),
-                get_safe_text(stmt, 1),
-                get_safe_text(stmt, 2),
-                get_safe_text(stmt, 3)
-                });
+        c->rec = rec;
+        c->seq.store(pos + 1, std::memory_order_release);
+    }
+};
+
+// Момент начала обработки текущего запроса, ставится в pre-routing и
+// сбрасывается логгером. Запрос, отклонённый httplib до pre-routing
+// (например, 400 на кривую строку запроса), пишется с латентностью «-».
+thread_local std::chrono::steady_clock::time_point request_start;
+
+// Сколько текущее соединение ждало рабочего в очереди пула; ставит
+// WorkStealingQueue, сбрасывает контроль допуска после первого запроса
+thread_local std::chrono::steady_clock::duration queue_wait{};
+
+void logger(AccessLog& log, const Request& req, const Response& res)
+{
+    total_requests++;
+    LogRecord r;
+    r.time = std::chrono::system_clock::now();
+    std::snprintf(r.method, sizeof(r.method), "%s", req.method.c_str());
+    std::snprintf(r.path, sizeof(r.path), "%s", req.path.c_str());
+    r.status = res.status;
+    r.latencyUs = -1;
+    if (request_start != std::chrono::steady_clock::time_point()) {
+        r.latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - request_start).count();
+        request_start = std::chrono::steady_clock::time_point();
+    }
+    // Размер чанкового (в том числе сжимаемого на лету) ответа заранее
+    // не известен, а сколько байт ушло в сокет, httplib не сообщает
+    if (!res.body.empty()) r.bytes = (long long)res.body.size();
+    else if (res.content_length_ > 0 || !res.content_provider_) r.bytes = (long long)res.content_length_;
+    else r.bytes = -1;
+    log.push(r);
+}
+
+// Лента изменений для Server-Sent Events (GET /tasks/events).
+// httplib занимает рабочий поток на всё время жизни соединения, поэтому
+// подписчиков обслуживает отдельный порт: один поток с poll() принимает
+// соединения и раздаёт события, простаивающий подписчик стоит только сокет
+// и буфер. Последние kHistory событий хранятся для докачки по Last-Event-ID.
+// Подписчик, у которого неотправленного больше kMaxBuffered, отключается:
+// браузер переподключится и догонит ленту из истории.
+class ChangeFeed
+{
+    struct Event
+    {
+        uint64_t seq;
+        std::string frame;
+    };
+
+    struct Subscriber
+    {
+        socket_t sock;
+        bool streaming = false;
+        bool closing = false;
+        std::string in;
+        std::string out;
+        size_t sent = 0;
+        uint64_t seq = 0;
+        std::chrono::steady_clock::time_point lastWrite;
+    };
+
+    static const size_t kHistory = 4096;
+    static const size_t kMaxBuffered = 256u << 10;
+    static const size_t kMaxRequest = 8192;
+
+    std::mutex mtx;
+    std::deque<Event> history;
+    uint64_t lastSeq = 0;
+    std::string boot;
+
+    size_t maxSubscribers;
+    socket_t listener = INVALID_SOCKET;
+    socket_t wakeRecv = INVALID_SOCKET;
+    socket_t wakeSend = INVALID_SOCKET;
+    std::atomic<bool> woken{ false };
+    std::atomic<bool> stopping{ false };
+    std::thread loop;
+
+    static bool wouldBlock()
+    {
+#ifdef _WIN32
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+    }
+
+    static void closeSocket(socket_t& sock)
+    {
+        if (sock != INVALID_SOCKET) detail::close_socket(sock);
+        sock = INVALID_SOCKET;
+    }
+
+    std::string eventId(uint64_t seq) const
+    {
+        return boot + "-" + std::to_string(seq);
+    }
+
+    // Пара UDP-сокетов на loopback будит poll() при публикации события
+    bool openWakeup()
+    {
+        sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+
+        wakeRecv = socket(AF_INET, SOCK_DGRAM, 0);
+        wakeSend = socket(AF_INET, SOCK_DGRAM, 0);
+        if (wakeRecv == INVALID_SOCKET || wakeSend == INVALID_SOCKET) return false;
+        if (bind(wakeRecv, (sockaddr*)&addr, sizeof(addr)) != 0) return false;
+        if (getsockname(wakeRecv, (sockaddr*)&addr, &len) != 0) return false;
+        if (connect(wakeSend, (sockaddr*)&addr, sizeof(addr)) != 0) return false;
+        detail::set_nonblocking(wakeRecv, true);
+        detail::set_nonblocking(wakeSend, true);
+        return true;
+    }
+
+    bool openListener(int port)
+    {
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (listener == INVALID_SOCKET) return false;
+#ifndef _WIN32
+        int yes = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+#endif
+        sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons((unsigned short)port);
+        if (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0) return false;
+        if (::listen(listener, SOMAXCONN) != 0) return false;
+        detail::set_nonblocking(listener, true);
+        return true;
+    }
+
+    void wake()
+    {
+        if (wakeSend != INVALID_SOCKET && !woken.exchange(true)) {
+            char c = 0;
+            send(wakeSend, &c, 1, 0);
         }
-        sqlite3_finalize(stmt);
-        return results;
     }
 
-    std::pair<bool, Task> getOne(int id) {
+    static void respond(Subscriber& sub, const char* status, const char* headers = "")
+    {
+        sub.out = std::string("HTTP/1.1 ") + status + "\r\n" + headers +
+            "Access-Control-Allow-Origin: *\r\n"
+            "Access-Control-Allow-Methods: GET, OPTIONS\r\n"
+            "Access-Control-Allow-Headers: Last-Event-ID, Cache-Control\r\n"
+            "Content-Length: 0\r\nConnection: close\r\n\r\n";
+        sub.closing = true;
+    }
+
+    // Разбирает заголовки запроса и начинает поток. С Last-Event-ID
+    // (заголовок или параметр last_event_id) подписчик получает пропущенные
+    // события из истории; если их там уже нет или сервер перезапускался —
+    // событие reset, после которого клиент перечитывает список целиком.
+    void start(Subscriber& sub)
+    {
+        size_t lineEnd = sub.in.find("\r\n");
+        std::string line = sub.in.substr(0, lineEnd);
+        size_t sp1 = line.find(' ');
+        size_t sp2 = line.find(' ', sp1 + 1);
+        std::string method = line.substr(0, sp1);
+        std::string target = sp1 == std::string::npos ? "" : line.substr(sp1 + 1, sp2 - sp1 - 1);
+        std::string path = target.substr(0, target.find('?'));
+
+        if (method == "OPTIONS") return respond(sub, "204 No Content");
+        if (method != "GET" || path != "/tasks/events") return respond(sub, "404 Not Found");
+
+        std::string lastId;
+        size_t q = target.find("last_event_id=");
+        if (q != std::string::npos) {
+            lastId = target.substr(q + 14, target.find('&', q) - q - 14);
+        }
+        std::string lower = sub.in;
+        std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        size_t h = lower.find("\r\nlast-event-id:");
+        if (h != std::string::npos) {
+            size_t from = sub.in.find_first_not_of(' ', h + 16);
+            lastId = sub.in.substr(from, sub.in.find("\r\n", from) - from);
+        }
+
+        sub.out = "HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/event-stream\r\n"
+            "Cache-Control: no-cache\r\n"
+            "Access-Control-Allow-Origin: *\r\n"
+            "X-Accel-Buffering: no\r\n"
+            "Connection: keep-alive\r\n\r\n"
+            "retry: 3000\n\n";
+        sub.in.clear();
+        sub.in.shrink_to_fit();
+        sub.streaming = true;
+
         std::lock_guard<std::mutex> lock(mtx);
-        sqlite3_stmt* stmt;
-        Task t;
-        bool found = false;
+        uint64_t oldest = history.empty() ? lastSeq + 1 : history.front().seq;
+        size_t dash = lastId.rfind('-');
+        if (lastId.empty()) {
+            sub.seq = lastSeq;
+            sub.out += "id: " + eventId(lastSeq) + "\nevent: ready\ndata: {}\n\n";
+            return;
+        }
+        uint64_t seq = 0;
+        bool resumable = dash != std::string::npos && lastId.compare(0, dash, boot) == 0;
+        if (resumable) {
+            try { seq = std::stoull(lastId.substr(dash + 1)); }
+            catch (const std::exception&) { resumable = false; }
+        }
+        if (resumable && seq + 1 >= oldest && seq <= lastSeq) {
+            sub.seq = seq;
+        }
+        else {
+            sub.seq = lastSeq;
+            sub.out += "id: " + eventId(lastSeq) + "\nevent: reset\ndata: {}\n\n";
+        }
+    }
+
+    // Возвращает false, если соединение нужно закрыть
+    bool flush(Subscriber& sub)
+    {
+        while (sub.sent < sub.out.size()) {
+            ssize_t n = detail::send_socket(sub.sock, sub.out.data() + sub.sent, sub.out.size() - sub.sent,
+#ifdef MSG_NOSIGNAL
+                MSG_NOSIGNAL
+#else
+                0
+#endif
+            );
+            if (n <= 0) return n < 0 && wouldBlock();
+            sub.sent += (size_t)n;
+            sub.lastWrite = std::chrono::steady_clock::now();
+        }
+        sub.out.clear();
+        sub.sent = 0;
+        return !sub.closing;
+    }
+
+    // Возвращает false, если соединение нужно закрыть
+    bool readFrom(Subscriber& sub)
+    {
+        char buf[2048];
+        for (;;) {
+            ssize_t n = detail::read_socket(sub.sock, buf, sizeof(buf), 0);
+            if (n == 0) return false;
+            if (n < 0) return wouldBlock();
+            if (sub.streaming || sub.closing) continue;
+            sub.in.append(buf, (size_t)n);
+            if (sub.in.find("\r\n\r\n") != std::string::npos) {
+                start(sub);
+                return true;
+            }
+            if (sub.in.size() > kMaxRequest) return false;
+        }
+    }
 
-        if (sqlite3_prepare_v2(db, "SELECT id, title, description, status FROM tasks WHERE id = ?;", -1, &stmt, 0) == SQLITE_OK) {
-            sqlite3_bind_int(stmt, 1, id);
-            if (sqlite3_step(stmt) == SQLITE_ROW) {
-                t.id = sqlite3_column_int(stmt, 0);
-                t.title = get_safe_text(stmt, 1);
-                t.description = get_safe_text(stmt, 2);
-                t.status = get_safe_text(stmt, 3);
-                found = true;
+    void accept(std::vector<Subscriber>& subs)
+    {
+        for (;;) {
+            socket_t sock = ::accept(listener, nullptr, nullptr);
+            if (sock == INVALID_SOCKET) return;
+            detail::set_nonblocking(sock, true);
+            Subscriber sub;
+            sub.sock = sock;
+            sub.lastWrite = std::chrono::steady_clock::now();
+            if (subs.size() >= maxSubscribers) {
+                rejected++;
+                respond(sub, "503 Service Unavailable", "Retry-After: 5\r\n");
+                flush(sub);
+                closeSocket(sub.sock);
+                continue;
             }
-            sqlite3_finalize(stmt);
+            subs.push_back(std::move(sub));
         }
-        return { found, t };
     }
 
-    bool updateStatus(int id, std::string status)
+    // Дописывает подписчикам новые события из истории и пинги простаивающим
+    void fanOut(std::vector<Subscriber>& subs)
     {
+        auto now = std::chrono::steady_clock::now();
         std::lock_guard<std::mutex> lock(mtx);
-        sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, "UPDATE tasks SET status = ? WHERE id = ?;", -1, &stmt, 0) != SQLITE_OK) return false;
+        for (Subscriber& sub : subs) {
+            if (!sub.streaming) continue;
+            if (sub.seq < lastSeq && !history.empty()) {
+                if (sub.seq + 1 < history.front().seq) {
+                    sub.out += "id: " + eventId(lastSeq) + "\nevent: reset\ndata: {}\n\n";
+                }
+                else {
+                    for (size_t i = (size_t)(sub.seq + 1 - history.front().seq); i < history.size(); ++i) sub.out += history[i].frame;
+                }
+                sub.seq = lastSeq;
+            }
+            if (sub.out.empty() && now - sub.lastWrite > std::chrono::seconds(15)) sub.out = ": ping\n\n";
+        }
+    }
+
+    void run()
+    {
+        std::vector<Subscriber> subs;
+        std::vector<pollfd> fds;
+        while (!stopping) {
+            fds.clear();
+            fds.push_back({ listener, POLLIN, 0 });
+            fds.push_back({ wakeRecv, POLLIN, 0 });
+            for (const Subscriber& sub : subs) {
+                fds.push_back({ sub.sock, (short)(POLLIN | (sub.out.empty() ? 0 : POLLOUT)), 0 });
+            }
+            detail::poll_wrapper(fds.data(), (nfds_t)fds.size(), 1000);
+
+            if (fds[1].revents & POLLIN) {
+                char buf[64];
+                woken = false;
+                while (recv(wakeRecv, buf, sizeof(buf), 0) > 0) {}
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < subs.size(); ++i) {
+                Subscriber& sub = subs[i];
+                short ev = fds[i + 2].revents;
+                bool alive = !(ev & (POLLERR | POLLNVAL));
+                if (alive && (ev & (POLLIN | POLLHUP))) alive = readFrom(sub);
+                // Не приславший заголовки за 10 секунд отключается
+                if (alive && !sub.streaming && !sub.closing && now - sub.lastWrite > std::chrono::seconds(10)) alive = false;
+                if (!alive) sub.closing = true, sub.out.clear();
+            }
+            if (fds[0].revents & POLLIN) accept(subs);
+
+            fanOut(subs);
+
+            size_t kept = 0;
+            for (size_t i = 0; i < subs.size(); ++i) {
+                Subscriber& sub = subs[i];
+                bool alive = !(sub.closing && sub.out.empty()) && flush(sub);
+                if (alive && sub.out.size() - sub.sent > kMaxBuffered) {
+                    slowDropped++;
+                    alive = false;
+                }
+                if (!alive) {
+                    closeSocket(sub.sock);
+                    continue;
+                }
+                if (kept != i) subs[kept] = std::move(sub);
+                ++kept;
+            }
+            subs.resize(kept);
+            subscribers = (long long)std::count_if(subs.begin(), subs.end(), [](const Subscriber& s) { return s.streaming; });
+        }
+        for (Subscriber& sub : subs) closeSocket(sub.sock);
+    }
+
+public:
+    std::atomic<long long> subscribers{ 0 };
+    std::atomic<long long> slowDropped{ 0 };
+    std::atomic<long long> rejected{ 0 };
+
+    // port == 0 отключает ленту
+    ChangeFeed(int port, size_t maxSubscribers)
+        : boot(std::to_string(std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count())),
+        maxSubscribers(maxSubscribers)
+    {
+        if (port == 0) return;
+        if (!openWakeup() || !openListener(port)) {
+            std::cerr << "Event stream: cannot listen on port " << port << std::endl;
+            closeSocket(listener);
+            closeSocket(wakeRecv);
+            closeSocket(wakeSend);
+            return;
+        }
+        loop = std::thread(&ChangeFeed::run, this);
+    }
+    ~ChangeFeed()
+    {
+        stopping = true;
+        wake();
+        if (loop.joinable()) loop.join();
+        closeSocket(listener);
+        closeSocket(wakeRecv);
+        closeSocket(wakeSend);
+    }
+    ChangeFeed(const ChangeFeed&) = delete;
+    ChangeFeed& operator=(const ChangeFeed&) = delete;
 
-        sqlite3_bind_text(stmt, 1, status.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int(stmt, 2, id);
-        sqlite3_step(stmt);
-        bool changed = sqlite3_changes(db) > 0;
-        sqlite3_finalize(stmt);
-        return changed;
+    bool enabled() const
+    {
+        return listener != INVALID_SOCKET;
     }
 
-    bool updateFull(int id, const Task& t) {
-        std::lock_guard<std::mutex> lock(mtx);
-        sqlite3_stmt* stmt;
-        const char* sql = "UPDATE tasks SET title = ?, description = ?, status = ? WHERE id = ?;";
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK) return false;
+    // type: created, updated или deleted; data — JSON задачи или её части
+    void publish(const char* type, const std::string& data)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            ++lastSeq;
+            history.push_back({ lastSeq, "id: " + eventId(lastSeq) + "\nevent: " + type + "\ndata: " + data + "\n\n" });
+            if (history.size() > kHistory) history.pop_front();
+        }
+        wake();
+    }
+};
 
-        sqlite3_bind_text(stmt, 1, t.title.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, t.description.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 3, t.status.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int(stmt, 4, id);
-        sqlite3_step(stmt);
-        bool changed = sqlite3_changes(db) > 0;
-        sqlite3_finalize(stmt);
-        return changed;
+// Событие ленты для изменения, применённого писателем
+void publish_change(ChangeFeed& feed, const Mutation& m)
+{
+    std::string data;
+    switch (m.kind) {
+    case Mutation::Kind::Insert:
+        feed.publish("created", task_json(m.task));
+        break;
+    case Mutation::Kind::UpdateFull:
+        feed.publish("updated", task_json(m.task));
+        break;
+    case Mutation::Kind::UpdateStatus:
+        data = "{\"id\":" + std::to_string(m.id) + ",\"status\":";
+        append_json_string(data, m.task.status.data(), m.task.status.size());
+        data += '}';
+        feed.publish("updated", data);
+        break;
+    case Mutation::Kind::Delete:
+        feed.publish("deleted", "{\"id\":" + std::to_string(m.id) + "}");
+        break;
     }
+}
+
+// Счётчики пула рабочих потоков для /metrics. Живут в main, потому что
+// очередь создаёт и удаляет сам httplib внутри listen().
+struct WorkerPoolStats
+{
+    std::atomic<unsigned> threads{ 0 };
+    std::atomic<long long> depth{ 0 };
+    std::atomic<long long> executed{ 0 };
+    std::atomic<long long> steals{ 0 };
+    std::atomic<long long> rejected{ 0 };
+    // Ожидание в очереди последнего взятого соединения
+    std::atomic<long long> queueWaitUs{ 0 };
+};
 
-    bool deleteTask(int id)
+// Пул рабочих потоков для httplib со своей очередью у каждого потока.
+// Поток принимающий соединения раскладывает задачи по очередям по кругу,
+// так что он и рабочие почти не делят один мьютекс. Рабочий берёт задачи
+// из своей очереди, а когда она пуста — крадёт из чужих (try_lock, чтобы
+// не ждать занятую). Спящие рабочие ждут на общей условной переменной,
+// её трогают только когда кто-то действительно спит.
+class WorkStealingQueue : public TaskQueue
+{
+    struct Job
     {
-        std::lock_guard<std::mutex> lock(mtx);
-        sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, "DELETE FROM tasks WHERE id = ?;", -1, &stmt, 0) != SQLITE_OK) return false;
+        std::function<void()> fn;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    struct alignas(64) Lane
+    {
+        std::mutex mtx;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<Lane>> lanes;
+    std::vector<std::thread> workers;
+    WorkerPoolStats& stats;
+    size_t maxQueued;
+
+    std::atomic<size_t> next{ 0 };
+    std::atomic<long long> pending{ 0 };
+    std::atomic<int> idle{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::mutex sleepMtx;
+    std::condition_variable sleepCv;
+
+    bool take(size_t self, Job& fn)
+    {
+        {
+            Lane& own = *lanes[self];
+            std::lock_guard<std::mutex> lock(own.mtx);
+            if (!own.jobs.empty()) {
+                fn = std::move(own.jobs.front());
+                own.jobs.pop_front();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < lanes.size(); ++i) {
+            Lane& victim = *lanes[(self + i) % lanes.size()];
+            std::unique_lock<std::mutex> lock(victim.mtx, std::try_to_lock);
+            if (!lock.owns_lock() || victim.jobs.empty()) continue;
+            fn = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            stats.steals++;
+            return true;
+        }
+        return false;
+    }
+
+    void work(size_t self)
+    {
+        Job job;
+        for (;;) {
+            if (take(self, job)) {
+                pending--;
+                stats.depth = pending.load();
+                queue_wait = std::chrono::steady_clock::now() - job.queued;
+                stats.queueWaitUs = std::chrono::duration_cast<std::chrono::microseconds>(queue_wait).count();
+                job.fn();
+                job.fn = nullptr;
+                stats.executed++;
+                continue;
+            }
+            // Очередь могла быть занята при попытке кражи: пока pending > 0,
+            // спать нельзя, пробуем ещё раз
+            if (pending.load() > 0) {
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMtx);
+            idle++;
+            sleepCv.wait(lock, [this] { return pending.load() > 0 || stopping.load(); });
+            idle--;
+            if (stopping && pending.load() == 0) return;
+        }
+    }
+
+public:
+    // maxQueued == 0 — без ограничения длины очереди
+    WorkStealingQueue(unsigned threadCount, WorkerPoolStats& stats, size_t maxQueued = 0)
+        : stats(stats), maxQueued(maxQueued)
+    {
+        if (threadCount == 0) threadCount = 1;
+        stats.threads = threadCount;
+        for (unsigned i = 0; i < threadCount; ++i) lanes.emplace_back(new Lane);
+        for (unsigned i = 0; i < threadCount; ++i) workers.emplace_back(&WorkStealingQueue::work, this, i);
+    }
+
+    bool enqueue(std::function<void()> fn) override
+    {
+        if (maxQueued > 0 && pending.load() >= (long long)maxQueued) {
+            stats.rejected++;
+            return false;
+        }
+        Lane& lane = *lanes[next++ % lanes.size()];
+        {
+            std::lock_guard<std::mutex> lock(lane.mtx);
+            lane.jobs.push_back(Job{ std::move(fn), std::chrono::steady_clock::now() });
+        }
+        pending++;
+        stats.depth = pending.load();
+        if (idle.load() > 0) {
+            std::lock_guard<std::mutex> lock(sleepMtx);
+            sleepCv.notify_one();
+        }
+        return true;
+    }
 
-        sqlite3_bind_int(stmt, 1, id);
-        sqlite3_step(stmt);
-        bool deleted = sqlite3_changes(db) > 0;
-        sqlite3_finalize(stmt);
-        return deleted;
+    // Оставшиеся в очередях задачи дорабатываются до выхода потоков
+    void shutdown() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMtx);
+            stopping = true;
+        }
+        sleepCv.notify_all();
+        for (auto& t : workers) t.join();
+        workers.clear();
     }
 };
 
-void logger(const Request& req, const Response& res)
+struct AdmissionOptions
 {
-    total_requests++;
-    auto t = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-    std::cout << "[" << std::put_time(std::localtime(&t), "%H:%M:%S") << "] "
-        << req.method << " " << req.path << " -> " << res.status << std::endl;
+    // Запросов в секунду с одного IP и запас на всплеск; 0 — без ограничения
+    double ratePerSec = 0;
+    unsigned burst = 20;
+    // Запросов в обработке одновременно; 0 — без ограничения
+    unsigned maxInFlight = 0;
+    // Пороги сброса нагрузки: длина очереди пула и ожидание соединения
+    // в ней; 0 — порог не проверяется
+    size_t shedQueueDepth = 0;
+    unsigned shedQueueDelayMs = 0;
+};
+
+// Контроль допуска: решает до чтения тела, обслуживать ли запрос.
+// Перегрузка (длинная очередь пула, соединение долго ждало рабочего,
+// слишком много запросов в обработке) — 503, превышение частоты с одного
+// IP (token bucket) — 429, оба с Retry-After. Быстрый отказ дешевле ответа,
+// которого клиент всё равно не дождётся. Слот запроса в обработке
+// отпускается в логгере: httplib вызывает его для каждого ответа.
+class AdmissionControl
+{
+    struct Bucket
+    {
+        double tokens;
+        std::chrono::steady_clock::time_point last;
+    };
+
+    struct alignas(64) BucketShard
+    {
+        std::mutex mtx;
+        std::unordered_map<std::string, Bucket> buckets;
+    };
+
+    static const size_t kBucketShards = 16;
+    // Сверх этого корзины, успевшие наполниться (клиент давно молчит), удаляются
+    static const size_t kMaxBucketsPerShard = 4096;
+
+    AdmissionOptions opts;
+    WorkerPoolStats& pool;
+    BucketShard shards[kBucketShards];
+
+    static thread_local bool holdsSlot;
+
+    double refill(const Bucket& b, std::chrono::steady_clock::time_point now) const
+    {
+        double elapsed = std::chrono::duration<double>(now - b.last).count();
+        return std::min((double)opts.burst, b.tokens + elapsed * opts.ratePerSec);
+    }
+
+    // 0 — токен взят, иначе через сколько секунд появится следующий
+    unsigned takeToken(const std::string& ip)
+    {
+        BucketShard& s = shards[std::hash<std::string>()(ip) % kBucketShards];
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(s.mtx);
+        if (s.buckets.size() >= kMaxBucketsPerShard) {
+            for (auto it = s.buckets.begin(); it != s.buckets.end();) {
+                if (refill(it->second, now) >= opts.burst) it = s.buckets.erase(it);
+                else ++it;
+            }
+        }
+        auto it = s.buckets.find(ip);
+        if (it == s.buckets.end()) it = s.buckets.emplace(ip, Bucket{ (double)opts.burst, now }).first;
+        Bucket& b = it->second;
+        b.tokens = refill(b, now);
+        b.last = now;
+        if (b.tokens >= 1) {
+            b.tokens -= 1;
+            return 0;
+        }
+        return (unsigned)std::ceil((1 - b.tokens) / opts.ratePerSec);
+    }
+
+    bool reject(const Request& req, Response& res, int status, unsigned retryAfter, const char* error)
+    {
+        res.status = status;
+        res.set_header("Retry-After", std::to_string(retryAfter));
+        send_body(req, res, json{ { "error", error } }.dump());
+        return false;
+    }
+
+public:
+    std::atomic<long long> inFlight{ 0 };
+    std::atomic<long long> admitted{ 0 };
+    std::atomic<long long> rateLimited{ 0 };
+    std::atomic<long long> concurrencyShed{ 0 };
+    std::atomic<long long> queueDepthShed{ 0 };
+    std::atomic<long long> queueDelayShed{ 0 };
+
+    AdmissionControl(const AdmissionOptions& opts, WorkerPoolStats& pool)
+        : opts(opts), pool(pool)
+    {
+        if (this->opts.burst == 0) this->opts.burst = 1;
+    }
+
+    // false — ответ с отказом уже записан в res
+    bool admit(const Request& req, Response& res)
+    {
+        // Слот прошлого запроса этого потока, если логгер его не отпустил:
+        // без этого in_flight навсегда остался бы на единицу больше
+        release();
+
+        // В очереди ждало соединение, а не запрос: следующие запросы
+        // того же keep-alive соединения её уже не ждали
+        auto waited = queue_wait;
+        queue_wait = std::chrono::steady_clock::duration::zero();
+        if (opts.shedQueueDelayMs > 0 && waited >= std::chrono::milliseconds(opts.shedQueueDelayMs)) {
+            queueDelayShed++;
+            return reject(req, res, 503, 1, "Server overloaded");
+        }
+        if (opts.shedQueueDepth > 0 && pool.depth.load() >= (long long)opts.shedQueueDepth) {
+            queueDepthShed++;
+            return reject(req, res, 503, 1, "Server overloaded");
+        }
+        if (opts.ratePerSec > 0) {
+            unsigned retryAfter = takeToken(req.remote_addr);
+            if (retryAfter > 0) {
+                rateLimited++;
+                return reject(req, res, 429, retryAfter, "Too many requests");
+            }
+        }
+        long long n = ++inFlight;
+        if (opts.maxInFlight > 0 && n > (long long)opts.maxInFlight) {
+            inFlight--;
+            concurrencyShed++;
+            return reject(req, res, 503, 1, "Server overloaded");
+        }
+        holdsSlot = true;
+        admitted++;
+        return true;
+    }
+
+    // Отпускает слот допущенного запроса этого потока, если он есть
+    void release()
+    {
+        if (!holdsSlot) return;
+        holdsSlot = false;
+        inFlight--;
+    }
+
+    size_t clients()
+    {
+        size_t n = 0;
+        for (BucketShard& s : shards) {
+            std::lock_guard<std::mutex> lock(s.mtx);
+            n += s.buckets.size();
+        }
+        return n;
+    }
+};
+
+thread_local bool AdmissionControl::holdsSlot = false;
+
+struct ServerConfig
+{
+    unsigned logSampleEvery = 1;
+    size_t logBufferSize = 8192;
+    int eventsPort = 8082;
+    size_t eventsMaxSubscribers = 10000;
+    // 0 — как в httplib: max(8, число ядер - 1)
+    unsigned threads = 0;
+    size_t maxQueued = 0;
+    // sqlite, memory или log
+    std::string store = "sqlite";
+    // Для --store=log
+    JournalOptions journal;
+    // Для --store=sqlite: профиль --sqlite-profile и поверх него --sqlite-<pragma>
+    SqliteOptions sqlite;
+    AdmissionOptions admission;
+};
+
+// always, never или интервал fsync в миллисекундах
+JournalOptions::Sync parse_fsync(const std::string& value, unsigned& intervalMs)
+{
+    if (value == "always") return JournalOptions::Sync::Always;
+    if (value == "never") return JournalOptions::Sync::Never;
+    size_t pos = 0;
+    unsigned long ms = std::stoul(value, &pos);
+    if (pos != value.size() || ms == 0) throw std::invalid_argument(value);
+    intervalMs = (unsigned)ms;
+    return JournalOptions::Sync::Interval;
+}
+
+// cache-size -> cache_size
+std::string pragma_name(std::string flag)
+{
+    std::replace(flag.begin(), flag.end(), '-', '_');
+    return flag;
+}
+
+// Флаги запуска в виде --name=value
+bool parse_args(int argc, char** argv, ServerConfig& cfg)
+{
+    // Отдельные PRAGMA применяются после профиля, где бы он ни стоял
+    std::string sqliteProfile = "default";
+    std::vector<std::pair<std::string, std::string>> sqlitePragmas;
+    SqliteOptions probe;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return false;
+        }
+        std::string name = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+        try {
+            if (name == "log-sample") cfg.logSampleEvery = std::stoul(value);
+            else if (name == "log-buffer") cfg.logBufferSize = std::stoul(value);
+            else if (name == "events-port") cfg.eventsPort = std::stoi(value);
+            else if (name == "events-max-subscribers") cfg.eventsMaxSubscribers = std::stoul(value);
+            else if (name == "threads") cfg.threads = std::stoul(value);
+            else if (name == "max-queued") cfg.maxQueued = std::stoul(value);
+            else if (name == "rate-limit") {
+                cfg.admission.ratePerSec = std::stod(value);
+                if (!(cfg.admission.ratePerSec >= 0)) throw std::invalid_argument(value);
+            }
+            else if (name == "rate-burst") cfg.admission.burst = std::stoul(value);
+            else if (name == "max-in-flight") cfg.admission.maxInFlight = std::stoul(value);
+            else if (name == "shed-queue-depth") cfg.admission.shedQueueDepth = std::stoul(value);
+            else if (name == "shed-queue-delay") cfg.admission.shedQueueDelayMs = std::stoul(value);
+            else if (name == "store" && (value == "sqlite" || value == "memory" || value == "log")) cfg.store = value;
+            else if (name == "store") throw std::invalid_argument(value);
+            else if (name == "journal-fsync") cfg.journal.sync = parse_fsync(value, cfg.journal.syncIntervalMs);
+            else if (name == "snapshot-interval") cfg.journal.snapshotIntervalSec = std::stoul(value);
+            else if (name == "sqlite-profile" && SqliteOptions::profile(value, probe)) sqliteProfile = value;
+            else if (name == "sqlite-profile") throw std::invalid_argument(value);
+            else if (name.compare(0, 7, "sqlite-") == 0 && probe.set(pragma_name(name.substr(7)), value)) {
+                sqlitePragmas.emplace_back(pragma_name(name.substr(7)), value);
+            }
+            else {
+                std::cerr << "Unknown option: --" << name << std::endl;
+                return false;
+            }
+        }
+        catch (const std::exception&) {
+            std::cerr << "Invalid value for --" << name << ": " << value << std::endl;
+            return false;
+        }
+    }
+    SqliteOptions::profile(sqliteProfile, cfg.sqlite);
+    for (const auto& p : sqlitePragmas) cfg.sqlite.set(p.first, p.second);
+    return true;
+}
+
+std::unique_ptr<TaskStore> make_store(const ServerConfig& cfg)
+{
+    if (cfg.store == "memory") return std::make_unique<MemoryStore>();
+    if (cfg.store == "log") return std::make_unique<LogStore>("todo_list", cfg.journal);
+    return std::make_unique<Database>("todo_list.db", cfg.sqlite);
 }
 
-int main() {
+int main(int argc, char** argv) {
+    ServerConfig cfg;
+    if (!parse_args(argc, argv, cfg)) return 1;
+
     system("chcp 65001");
-    Database db("todo_list.db");
+    ChangeFeed feed(cfg.eventsPort, cfg.eventsMaxSubscribers);
+    std::unique_ptr<TaskStore> store = make_store(cfg);
+    TaskStore& db = *store;
+    if (feed.enabled()) db.onChange([&feed](const Mutation& m) { publish_change(feed, m); });
+    AccessLog accessLog(cfg.logBufferSize, cfg.logSampleEvery);
 
     auto svr = std::make_unique<Server>();
-    svr->set_logger(logger);
+    WorkerPoolStats poolStats;
+    unsigned threads = cfg.threads ? cfg.threads : (unsigned)CPPHTTPLIB_THREAD_POOL_COUNT;
+    svr->new_task_queue = [&] { return new WorkStealingQueue(threads, poolStats, cfg.maxQueued); };
+    // httplib пишет заголовки и тело ответа отдельными send(); с Nagle второй
+    // ждёт ACK, который клиент на keep-alive откладывает на ~40 мс
+    svr->set_tcp_nodelay(true);
 
     auto enable_cors = [](Response& res) {
         res.set_header("Access-Control-Allow-Origin", "*");
         res.set_header("Access-Control-Allow-Methods", "GET, POST, PUT, PATCH, DELETE, OPTIONS");
-        res.set_header("Access-Control-Allow-Headers", "Content-Type, X-Auth-Token");
+        res.set_header("Access-Control-Allow-Headers", "Content-Type, X-Auth-Token, If-None-Match");
+        res.set_header("Access-Control-Expose-Headers", "ETag, X-Next-After-Id");
         };
 
-    svr->Get("/", [](const Request&, Response& res) {
-        std::ifstream f("index.html");
-        if (f) {
-            std::stringstream ss; ss << f.rdbuf();
-            res.set_content(ss.str(), "text/html");
-        }
-        else {
-            res.status = 404;
-            res.set_content("Error: index.html not found", "text/plain");
-        }
+    // /metrics отвечает и при перегрузке, иначе её не увидеть
+    AdmissionControl admission(cfg.admission, poolStats);
+    svr->set_pre_routing_handler([&](const Request& req, Response& res) {
+        request_start = std::chrono::steady_clock::now();
+        if (req.path == "/metrics" || admission.admit(req, res)) return Server::HandlerResponse::Unhandled;
+        enable_cors(res);
+        return Server::HandlerResponse::Handled;
+        });
+    svr->set_logger([&](const Request& req, const Response& res) {
+        admission.release();
+        logger(accessLog, req, res);
+        });
+
+    ResponseCache bodies(kResponseCacheBytes);
+
+    StaticAsset indexPage("index.html", "text/html");
+    svr->Get("/", [&](const Request& req, Response& res) {
+        serve_static(indexPage, req, res);
         });
 
-    svr->Get("/metrics", [&](const Request&, Response& res) {
+    svr->Get("/metrics", [&](const Request& req, Response& res) {
         enable_cors(res); // Сначала CORS
         json m;
         m["total_calls"] = (int)total_requests;
-        m["db_size"] = db.getAll().size();
-        res.set_content(m.dump(4), "application/json");
+        m["log_dropped"] = accessLog.dropped.load();
+        auto counts = db.getCounts();
+        m["db_size"] = counts.total;
+        m["tasks_by_status"] = counts.byStatus;
+        m["store"] = db.stats();
+        m["events"] = {
+            {"subscribers", feed.subscribers.load()},
+            {"slow_dropped", feed.slowDropped.load()},
+            {"rejected", feed.rejected.load()}
+        };
+        m["workers"] = {
+            {"threads", poolStats.threads.load()},
+            {"queue_depth", poolStats.depth.load()},
+            {"executed", poolStats.executed.load()},
+            {"steals", poolStats.steals.load()},
+            {"rejected", poolStats.rejected.load()},
+            {"queue_wait_ms", poolStats.queueWaitUs.load() / 1000.0}
+        };
+        m["admission"] = {
+            {"in_flight", admission.inFlight.load()},
+            {"admitted", admission.admitted.load()},
+            {"clients", admission.clients()},
+            {"shed", {
+                {"rate_limited", admission.rateLimited.load()},
+                {"concurrency", admission.concurrencyShed.load()},
+                {"queue_depth", admission.queueDepthShed.load()},
+                {"queue_delay", admission.queueDelayShed.load()}
+            }}
+        };
+        send_body(req, res, m.dump(4));
+        });
+
+    // GET /tasks?limit=&after_id= отдаёт одну страницу, следующая начинается
+    // с X-Next-After-Id. Без параметров весь список стримится чанками
+    // по kStreamPage строк, так что память не зависит от размера таблицы.
+    svr->Get("/tasks", [&](const Request& req, Response& res) {
+        enable_cors(res);
+        uint64_t version = db.dataVersion();
+        if (not_modified(req, res, make_etag(version))) return;
+
+        bool paged = req.has_param("limit") || req.has_param("after_id");
+        std::string status = req.has_param("status") ? req.get_param_value("status") : "";
+        int limit = 0, afterId = 0;
+        if (paged) {
+            try {
+                limit = int_param(req, "limit", kDefaultPage);
+                afterId = int_param(req, "after_id", 0);
+            }
+            catch (const std::exception&) {
+                res.status = 400;
+                send_body(req, res, "{\"error\": \"Invalid paging parameters\"}");
+                return;
+            }
+            limit = std::max(1, std::min(limit, kMaxPage));
+        }
+
+        // Сжатые ответы кэшируются до следующего изменения данных;
+        // слишком большой список сжимается на лету при стриминге.
+        std::string encoding = pick_encoding(req);
+        if (!encoding.empty() && (paged || db.size() <= kMaxCachedRows)) {
+            std::string key = req.target + "|" + encoding;
+            auto entry = bodies.get(key, version);
+            if (!entry) {
+                auto e = std::make_shared<CachedBody>();
+                e->version = version;
+                std::string plain = "[";
+                bool first = true;
+                int lastId = afterId;
+                if (paged) {
+                    if (append_tasks(db, status, lastId, limit, plain, first) == limit) e->nextAfterId = std::to_string(lastId);
+                }
+                else {
+                    while (append_tasks(db, status, lastId, kStreamPage, plain, first) == kStreamPage) {}
+                }
+                plain += ']';
+                e->body = compress_body(plain, encoding);
+                bodies.put(key, e);
+                entry = e;
+            }
+            send_cached(res, entry, encoding, "application/json");
+            return;
+        }
+
+        if (paged) {
+            std::string body = "[";
+            bool first = true;
+            int lastId = afterId;
+            if (append_tasks(db, status, lastId, limit, body, first) == limit) {
+                res.set_header("X-Next-After-Id", std::to_string(lastId));
+            }
+            body += ']';
+            send_body(req, res, std::move(body));
+            return;
+        }
+
+        // Буфер чанка переиспользуется между вызовами провайдера. Чанки
+        // сжимаются здесь же: тип с параметром charset не входит в список
+        // сжимаемых типов httplib, и сам он этот ответ не сжимает.
+        struct StreamState
+        {
+            std::string status;
+            int lastId = 0;
+            bool first = true;
+            std::string chunk;
+            std::unique_ptr<detail::compressor> compressor;
+        };
+        auto state = std::make_shared<StreamState>();
+        state->status = status;
+        state->compressor = make_compressor(encoding);
+        set_encoding(res, encoding);
+        res.set_chunked_content_provider("application/json; charset=utf-8", [&db, state](size_t, DataSink& sink) {
+            std::string& chunk = state->chunk;
+            chunk.assign(state->first ? "[" : "");
+            int rows = append_tasks(db, state->status, state->lastId, kStreamPage, chunk, state->first);
+            bool last = rows < kStreamPage;
+            if (last) chunk += ']';
+            bool ok = state->compressor
+                ? state->compressor->compress(chunk.data(), chunk.size(), last, [&sink](const char* p, size_t n) {
+                    return n == 0 || sink.write(p, n);
+                    })
+                : sink.write(chunk.data(), chunk.size());
+            if (!ok) return false;
+            if (last) sink.done();
+            return true;
+            });
+        });
+
+    // Лента событий живёт на своём порту (см. ChangeFeed); здесь только
+    // перенаправление, EventSource следует за ним сам
+    svr->Get("/tasks/events", [&](const Request& req, Response& res) {
+        enable_cors(res);
+        if (!feed.enabled()) {
+            res.status = 404;
+            send_body(req, res, "{\"error\": \"Event stream is disabled\"}");
+            return;
+        }
+        std::string host = req.get_header_value("Host");
+        size_t colon = host.rfind(':');
+        if (colon != std::string::npos && host.find(']', colon) == std::string::npos) host.erase(colon);
+        if (host.empty()) host = "localhost";
+        res.set_redirect("http://" + host + ":" + std::to_string(cfg.eventsPort) + req.target, 307);
+        });
+
+    // GET /tasks/changes?since=&limit= — задачи, изменённые после версии
+    // since, и id удалённых; version — с неё запрашивать следующую порцию
+    svr->Get("/tasks/changes", [&](const Request& req, Response& res) {
+        enable_cors(res);
+        long long since = 0;
+        int limit = 0;
+        try {
+            std::string v = req.has_param("since") ? req.get_param_value("since") : "0";
+            size_t pos = 0;
+            since = std::stoll(v, &pos);
+            if (pos != v.size() || since < 0) throw std::invalid_argument("since");
+            limit = int_param(req, "limit", kMaxPage);
+        }
+        catch (const std::exception&) {
+            res.status = 400;
+            send_body(req, res, "{\"error\": \"Invalid sync parameters\"}");
+            return;
+        }
+        limit = std::max(1, std::min(limit, kMaxPage));
+        if (not_modified(req, res, make_etag(db.dataVersion()))) return;
+
+        std::string tasks = "[", deleted = "[";
+        long long version = since;
+        int rows = db.forEachChangeSince(since, limit, [&](const TaskChange& c) {
+            version = c.version;
+            if (c.deleted) {
+                if (deleted.size() > 1) deleted += ',';
+                deleted += std::to_string(c.id);
+            }
+            else {
+                if (tasks.size() > 1) tasks += ',';
+                append_task_json(tasks, c.task);
+            }
+            });
+        std::string body = "{\"tasks\":" + tasks + "],\"deleted\":" + deleted + "],\"version\":" + std::to_string(version)
+            + ",\"has_more\":" + (rows == limit ? "true" : "false") + "}";
+        send_body(req, res, std::move(body));
         });
 
-    svr->Get("/tasks", [&](const Request&, Response& res) {
+    // GET /tasks/search?q=&limit=&snippet=1 — задачи по релевантности;
+    // со snippet=1 у каждой есть поле snippet с подсвеченным фрагментом.
+    svr->Get("/tasks/search", [&](const Request& req, Response& res) {
         enable_cors(res);
-        auto tasks = db.getAll();
-        res.set_content(json(tasks).dump(), "application/json");
+        std::vector<std::string> terms = search_terms(req.get_param_value("q"));
+        if (terms.empty()) {
+            res.status = 400;
+            send_body(req, res, "{\"error\": \"Query is empty\"}");
+            return;
+        }
+        int limit = 0;
+        try {
+            limit = int_param(req, "limit", kDefaultSearch);
+        }
+        catch (const std::exception&) {
+            res.status = 400;
+            send_body(req, res, "{\"error\": \"Invalid limit\"}");
+            return;
+        }
+        limit = std::max(1, std::min(limit, kMaxSearch));
+        bool snippet = req.get_param_value("snippet") == "1";
+
+        if (not_modified(req, res, make_etag(db.dataVersion()))) return;
+
+        std::string body = "[";
+        bool first = true;
+        int rows = db.search(terms, limit, snippet, [&](const Task& t, const std::string& text) {
+            if (!first) body += ',';
+            first = false;
+            append_task_json(body, t);
+            if (snippet) {
+                body.back() = ',';
+                body += "\"snippet\":";
+                append_json_string(body, text.data(), text.size());
+                body += '}';
+            }
+            });
+        if (rows < 0) {
+            res.headers.erase("ETag");
+            res.status = 503;
+            send_body(req, res, "{\"error\": \"Search unavailable\"}");
+            return;
+        }
+        body += ']';
+        send_body(req, res, std::move(body));
         });
 
     svr->Get(R"(/tasks/(\d+))", [&](const Request& req, Response& res) {
         enable_cors(res);
         int id = std::stoi(req.matches[1]);
+        std::string etag = make_etag(db.dataVersion());
+        if (not_modified(req, res, etag)) return;
         auto result = db.getOne(id);
         if (result.first) {
-            res.set_content(json(result.second).dump(), "application/json");
+            send_body(req, res, task_json(result.second));
         }
         else {
+            res.headers.erase("ETag");
             res.status = 404;
-            res.set_content("{}", "application/json");
+            send_body(req, res, "{}");
         }
         });
 
     svr->Post("/tasks", [&](const Request& req, Response& res) {
         enable_cors(res); 
-        try {
-            auto body = json::parse(req.body);
+        TaskBody body;
+        if (!parse_task_body(req.body, body)) {
+            res.status = 400;
+            std::cerr << "JSON Error: " << body.error << std::endl; 
+            send_body(req, res, "{\"error\": \"Invalid JSON\"}");
+            return;
+        }
 
-            std::string title;
-            if (body.contains("title") && body["title"].is_string()) {
-                title = body["title"].get<std::string>();
-            }
+        if (!body.hasTitle || body.title.empty()) {
+            res.status = 400;
+            send_body(req, res, "{\"error\": \"Title is empty\"}");
+            return;
+        }
+
+        Task t{ 0, std::move(body.title), body.hasDescription ? std::move(body.description) : "", "todo" };
+        db.addTask(t);
+
+        res.status = 201;
+        send_body(req, res, task_json(t));
+        });
 
-            if (title.empty()) {
+    // Тело — массив операций {"op": "create|update|patch|delete", ...}.
+    // Все операции выполняются одной транзакцией, ответ — массив
+    // результатов в том же порядке.
+    svr->Post("/tasks/batch", [&](const Request& req, Response& res) {
+        enable_cors(res);
+        std::vector<Mutation> items;
+        try {
+            auto body = json::parse(req.body);
+            if (!body.is_array() || body.size() > kMaxBatchOps) {
                 res.status = 400;
-                res.set_content("{\"error\": \"Title is empty\"}", "application/json");
+                send_body(req, res, "{\"error\": \"Expected an array of at most 1000 operations\"}");
                 return;
             }
-
-            std::string desc = "";
-            if (body.contains("description") && body["description"].is_string()) {
-                desc = body["description"].get<std::string>();
+            items.resize(body.size());
+            for (size_t i = 0; i < body.size(); ++i) {
+                std::string error = parse_batch_item(body[i], items[i]);
+                if (error.empty() && items[i].kind != Mutation::Kind::Delete && !db.acceptsStatus(items[i].task.status)) {
+                    error = "Invalid status";
+                }
+                if (!error.empty()) {
+                    res.status = 400;
+                    send_body(req, res, json{ { "error", error }, { "index", i } }.dump());
+                    return;
+                }
             }
-
-            Task t{ 0, title, desc, "todo" };
-            db.addTask(t);
-
-            res.status = 201;
-            res.set_content(json(t).dump(), "application/json");
         }
         catch (const std::exception& e) {
             res.status = 400;
-            std::cerr << "JSON Error: " << e.what() << std::endl; 
-            res.set_content("{\"error\": \"Invalid JSON\"}", "application/json");
+            std::cerr << "JSON Error: " << e.what() << std::endl;
+            send_body(req, res, "{\"error\": \"Invalid JSON\"}");
+            return;
+        }
+
+        if (!db.applyBatch(items)) {
+            res.status = 500;
+            send_body(req, res, "{\"error\": \"Batch rolled back\"}");
+            return;
+        }
+
+        json results = json::array();
+        for (auto& m : items) {
+            json r;
+            if (m.kind == Mutation::Kind::Insert) {
+                m.task.id = (int)m.result;
+                r["status"] = 201;
+                r["task"] = m.task;
+            }
+            else if (m.result > 0) {
+                r["status"] = 200;
+                if (m.kind == Mutation::Kind::UpdateFull) {
+                    m.task.id = m.id;
+                    r["task"] = m.task;
+                }
+            }
+            else {
+                r["status"] = 404;
+            }
+            results.push_back(r);
         }
+        send_body(req, res, results.dump());
         });
 
     svr->Put(R"(/tasks/(\d+))", [&](const Request& req, Response& res) {
         enable_cors(res);
         int id = std::stoi(req.matches[1]);
-        try {
-            auto body = json::parse(req.body);
-            Task t;
-
-            if (!body.contains("title") || !body["title"].is_string()) throw std::runtime_error("Invalid title");
+        TaskBody body;
+        if (!parse_task_body(req.body, body) || !body.hasTitle) {
+            res.status = 400;
+            return;
+        }
 
-            t.title = body["title"].get<std::string>();
-            t.description = body.contains("description") && body["description"].is_string() ? body["description"].get<std::string>() : "";
-            t.status = body.contains("status") && body["status"].is_string() ? body["status"].get<std::string>() : "todo";
+        Task t;
+        t.title = std::move(body.title);
+        t.description = body.hasDescription ? std::move(body.description) : "";
+        t.status = body.hasStatus ? std::move(body.status) : "todo";
+        if (!db.acceptsStatus(t.status)) {
+            res.status = 400;
+            send_body(req, res, "{\"error\": \"Invalid status\"}");
+            return;
+        }
 
-            if (db.updateFull(id, t)) {
-                t.id = id;
-                res.status = 200;
-                res.set_content(json(t).dump(), "application/json");
-            }
-            else {
-                res.status = 404;
-            }
+        if (db.updateFull(id, t)) {
+            t.id = id;
+            res.status = 200;
+            send_body(req, res, task_json(t));
+        }
+        else {
+            res.status = 404;
         }
-        catch (...) { res.status = 400; }
         });
 
     svr->Patch(R"(/tasks/(\d+))", [&](const Request& req, Response& res) {
         enable_cors(res);
         int id = std::stoi(req.matches[1]);
-        try {
-            auto body = json::parse(req.body);
-            if (body.contains("status") && body["status"].is_string()) {
-                if (db.updateStatus(id, body["status"].get<std::string>())) {
-                    res.status = 200;
-                    res.set_content("{\"status\": \"updated\"}", "application/json");
-                }
-                else {
-                    res.status = 404;
-                }
-            }
-            else {
-                res.status = 400;
-            }
+        TaskBody body;
+        if (!parse_task_body(req.body, body) || !body.hasStatus) {
+            res.status = 400;
+            return;
+        }
+        if (!db.acceptsStatus(body.status)) {
+            res.status = 400;
+            send_body(req, res, "{\"error\": \"Invalid status\"}");
+            return;
+        }
+
+        if (db.updateStatus(id, std::move(body.status))) {
+            res.status = 200;
+            send_body(req, res, "{\"status\": \"updated\"}");
+        }
+        else {
+            res.status = 404;
         }
-        catch (...) { res.status = 400; }
         });
 
     svr->Delete(R"(/tasks/(\d+))", [&](const Request& req, Response& res) {